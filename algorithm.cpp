@@ -21,6 +21,13 @@
 #include "algorithm.h"
 #include "colorizedimage.h"
 #include "lsm.h"
+#include "profiler.h"
+#include "preprocessor.h"
+#include "fuseddetector.h"
+#include "labelmap.h"
+#include "tiffwriter.h"
+#include "segmentfile.h"
+#include "hotfolder.h"
 
 void Algorithm::run() {
 	emit progressMade(0);
@@ -28,56 +35,278 @@ void Algorithm::run() {
 	// output report
 	_report.reinit(
 		_params.out_dir, 
-		_params.class1_name, _params.class2_name, _params.class3_name);
+		_params.class1_name, _params.class2_name, _params.class3_name,
+		_params.hash(), _params.resume);
+
+	// when resuming, process only images which are not in the journal yet
+	if (_params.resume) {
+		QStringList pending;
+		for (QStringList::ConstIterator it = _images.begin(); it != _images.end(); ++it)
+			if (!_report.isJournaled(QFileInfo(*it)))
+				pending.append(*it);
+		_images = pending;
+	}
 
-	// for estimating time left
+	// for estimating time left, every image costs its planned detection iterations,
+	// with a time budget or auto-scaled iterations they are not known upfront
+	_progress.clear();
+	for (int i = 0; i < _images.size(); i++)
+		_progress.emplace_back();
+	_finished.assign(_images.size(), false);
+	bool autoScaled = _params.mainAlgo.sampling_density > 0 || (_params.removeCellEdges && _params.cellWalls.sampling_density > 0);
+	_imageCost = _params.timeBudgetMs > 0 || autoScaled ? 0 :
+		_params.mainAlgo.iterations + (_params.removeCellEdges ? _params.cellWalls.iterations : 0);
+	_lastIterations = 0;
+	_lastSampleMs = _lastStatusMs = 0;
 	_timer.start();
+	Profiler::reset();
 
 	// schedule worker threads
-	QStringList::ConstIterator img = _images.begin();
-	QThreadPool* pool = QThreadPool::globalInstance();
-	int maxThreads = std::max(1, QThread::idealThreadCount() - 1);
-	pool->setMaxThreadCount(maxThreads);
-	while (img != _images.end()) {
-		AlgorithmWorker* worker = new AlgorithmWorker(*img, _report, _params, _shouldStop);
-		connect(worker, &AlgorithmWorker::finished, this, &Algorithm::workerFinished);
-		pool->start(worker);
-		++img;
+	if (!_pool || !_pool->created(_params.threads, _params.pinThreads, _params.lowPriority)) {
+		// old workers are joined first, so the cores are not oversubscribed
+		_pool.reset();
+		_pool.reset(new WorkerPool(_params.threads, _params.pinThreads, _params.lowPriority));
+	}
+	WorkerPool* pool = _pool.get();
+	if (!_watchDir.isEmpty())
+		watch(pool);
+	for (int i = 0; i < _images.size(); i++)
+		pool->start(new AlgorithmWorker(_images.at(i), _report, _params, _shouldStop, _progress[i], *pool));
+
+	// sample the workers counters while waiting, doesn't need the event loop
+	while (!pool->waitForDone(SAMPLE_INTERVAL_MS)) {
+		sampleProgress();
+		emitFinishedImages();
 	}
-	pool->waitForDone();
+	emitFinishedImages();
 
 	// finish
 	_report.saveToDisk();
+	Profiler::saveTrace((_params.out_dir + "/BioLines2_trace.json").toStdString());
 	if (!_shouldStop) emit progressMade(100);
-	emit etaUpdated("");
+	// kept in the status when the run ends, otherwise cleared
+	int failures = writeFailures();
+	if (failures > 0) {
+		QString status = QString("%1 images not fully written to %2, they are not in the report").arg(failures).arg(_params.out_dir);
+		emit statusUpdated(status);
+		emit etaUpdated(status);
+	} else
+		emit etaUpdated("");
 }
 
-void Algorithm::workerFinished() {	
-	if (_shouldStop) return;
-	
-	_done++;
+void Algorithm::watch(WorkerPool* pool) {
+	_watched.clear();
+
+	HotFolder folder(_watchDir);
+	bool sameDir = QDir(_params.out_dir) == QDir(_watchDir);
+	connect(&folder, &HotFolder::imageReady, [&](const QString& fn) {
+		QFileInfo fi(fn);
+		// outputs written next to the images must not be processed again, those of a previous run as well
+		if (sameDir) {
+			QStringList outputs = AlgorithmWorker::outputImageFiles(_params, fi);
+			for (QStringList::ConstIterator it = outputs.begin(); it != outputs.end(); ++it)
+				folder.ignore(QFileInfo(*it).absoluteFilePath());
+		}
+		if (_params.resume && _report.isJournaled(fi)) return;
+		_watched.push_back(fn);
+		_progress.emplace_back();
+		pool->start(new AlgorithmWorker(_watched.back(), _report, _params, _shouldStop, _progress.back(), *pool));
+	});
+
+	// report is saved whenever some images are finished, not just at the end
+	size_t doneImages = 0;
+	QTimer sample;
+	connect(&sample, &QTimer::timeout, [&]() {
+		if (_shouldStop) {
+			quit();
+			return;
+		}
+		size_t done = 0;
+		for (std::deque<ImageProgress>::const_iterator it = _progress.begin(); it != _progress.end(); ++it)
+			if (it->done.load(std::memory_order_acquire))
+				done++;
+		if (done == doneImages) return;
+		doneImages = done;
+		_report.checkpoint();
+		QString status = QString("Watching %1, %2 images done, %3 in progress")
+			.arg(_watchDir)
+			.arg(done)
+			.arg(_progress.size() - done);
+		int failures = writeFailures();
+		if (failures > 0)
+			status += QString(", %1 not fully written").arg(failures);
+		emit etaUpdated(status);
+		emit statusUpdated(status);
+	});
+	sample.start(SAMPLE_INTERVAL_MS);
+	emit etaUpdated(QString("Watching %1").arg(_watchDir));
+
+	// running ones are stopped by the flag, the rest of run() waits for them
+	exec();
+}
 
-	// if we are done
-	if (_done == _images.size()) {
-		emit progressMade(100);
-		emit etaUpdated("");
-		return;
+void Algorithm::emitFinishedImages() {
+	for (int i = 0; i < _images.size(); i++)
+		if (!_finished[i] && _progress[i].done.load(std::memory_order_acquire)) {
+			_finished[i] = true;
+			emit imageFinished(_images.at(i));
+		}
+}
+
+int Algorithm::writeFailures() const {
+	int failures = 0;
+	for (std::deque<ImageProgress>::const_iterator it = _progress.begin(); it != _progress.end(); ++it)
+		if (it->done.load(std::memory_order_acquire) && it->writeFailed.load(std::memory_order_relaxed))
+			failures++;
+	return failures;
+}
+
+static inline QString formatDuration(int seconds) {
+	char str[64];
+	sprintf_s(str, 64, "%d:%.2d:%.2d", seconds / 3600, (seconds / 60) % 60, seconds % 60);
+	return str;
+}
+
+void Algorithm::sampleProgress() {
+	if (_shouldStop || _images.isEmpty()) return;
+
+	// sum the counters, every image costs its planned iterations, finished ones the full cost even if cut off earlier,
+	// auto-scaled budgets are known only once the detector has started, until then the mean of the known ones is used
+	long long iterations = 0, accepted = 0, doneCost = 0, knownCost = 0;
+	int doneImages = 0, knownImages = 0;
+	for (int i = 0; i < _images.size(); i++) {
+		const ImageProgress& progress = _progress[i];
+		long long imgIterations = progress.iterations.load(std::memory_order_relaxed);
+		iterations += imgIterations;
+		accepted += progress.accepted.load(std::memory_order_relaxed);
+		long long cost = _imageCost > 0 ? _imageCost : progress.budget.load(std::memory_order_relaxed);
+		if (cost > 0) {
+			knownCost += cost;
+			knownImages++;
+		}
+		if (progress.done.load(std::memory_order_acquire)) {
+			doneImages++;
+			doneCost += cost;
+		}
+		else
+			doneCost += std::min(imgIterations, cost);
+	}
+
+	// progress, with a time budget the costs are unknown so only finished images count
+	double meanCost = knownImages > 0 ? knownCost / static_cast<double>(knownImages) : 0;
+	double totalCost = knownCost + (_images.size() - knownImages) * meanCost;
+	double done = totalCost > 0 ? doneCost / totalCost : doneImages / static_cast<double>(_images.size());
+	emit progressMade(static_cast<int>(done * 100));
+
+	// live throughput since the last sample
+	qint64 now = _timer.elapsed();
+	double candidatesPerSec = now > _lastSampleMs ? (iterations - _lastIterations) * 1000.0 / (now - _lastSampleMs) : 0;
+	_lastIterations = iterations;
+	_lastSampleMs = now;
+	double acceptance = iterations > 0 ? accepted * 100.0 / iterations : 0;
+
+	// eta, assuming the rest costs the same per iteration as what's done so far
+	QString eta = "estimating ...";
+	if (done > 0)
+		eta = formatDuration(static_cast<int>(std::round(now / 1000.0 * (1 - done) / done))) + " left";
+	QString etaLine = QString("%1, %2k candidates/s, %3% accepted")
+		.arg(eta)
+		.arg(candidatesPerSec / 1000.0, 0, 'f', 0)
+		.arg(acceptance, 0, 'f', 1);
+	int failures = writeFailures();
+	if (failures > 0)
+		etaLine += QString(", %1 images not fully written").arg(failures);
+	emit etaUpdated(etaLine);
+
+	if (now - _lastStatusMs >= STATUS_INTERVAL_MS) {
+		_lastStatusMs = now;
+		emit statusUpdated(QString("%1/%2 images, %3%, %4 candidates/s, %5% accepted, %6")
+			.arg(doneImages)
+			.arg(_images.size())
+			.arg(done * 100, 0, 'f', 1)
+			.arg(candidatesPerSec, 0, 'f', 0)
+			.arg(acceptance, 0, 'f', 1)
+			.arg(eta) + (failures > 0 ? QString(", %1 not fully written").arg(failures) : QString()));
 	}
+}
+
+static inline QString colorString(const cv::Vec3b& color) {
+	return QString("%1,%2,%3").arg(color[0]).arg(color[1]).arg(color[2]);
+}
+
+static inline QString linesParametersString(const LinesParameters& p) {
+	// colors are included as the pixels are counted by color
+	return QString("%1;%2;%3;%4;%5;%6;%7;%8;%9;%10;%11")
+		.arg(colorString(p.color1))
+		.arg(colorString(p.color2))
+		.arg(colorString(p.color3))
+		.arg(p.line_length)
+		.arg(p.line_thickness)
+		.arg(p.iterations)
+		.arg(p.angle1)
+		.arg(p.angle2)
+		.arg(p.min_coverage)
+		.arg(p.tolerance)
+		.arg(p.sampling_density);
+}
+
+QString AlgorithmWorker::Parameters::hash() const {
+	QString values = QString("%1|%2|%3|%4|%5|%6|%7|%8|%9")
+		.arg(linesParametersString(cellWalls))
+		.arg(linesParametersString(mainAlgo))
+		.arg(autoRotate)
+		.arg(removeCellEdges)
+		.arg(timeBudgetMs)
+		.arg(thresholdBackend)
+		.arg(orientationMethod)
+		.arg(rotateClassifier)
+		.arg(fusedDetection);
+	return QString::fromLatin1(QCryptographicHash::hash(values.toUtf8(), QCryptographicHash::Sha1).toHex());
+}
 
-	// compute progress, first percent
-	emit progressMade(_done * 100.0f / static_cast<float>(_images.size()));
-	// eta
-	float timePerImage = _timer.elapsed() / 1000.0f / static_cast<float>(_done);
-	int eta = static_cast<int>(std::roundf((_images.size() - _done) * timePerImage));
-	char eta_str[128];
-	sprintf_s(eta_str, 128, "%d:%.2d:%.2d left", eta / 3600, (eta / 60) % 60, eta % 60);
-	emit etaUpdated(eta_str);
+cv::Mat AlgorithmWorker::readImage(const QString& fn) {
+	// handle Zeiss files as well
+	if (QFileInfo(fn).suffix().toLower() == "lsm")
+		return readLSM(fn);
+	return cv::imread(fn.toStdString(), CV_LOAD_IMAGE_GRAYSCALE);
 }
 
-cv::Mat AlgorithmWorker::readLSM() {
+QStringList AlgorithmWorker::outputImageFiles(const AlgorithmWorker::Parameters& params, const QFileInfo& fi) {
+	QStringList files;
+	if (params.container)
+		files.append(containerName(params.out_dir, fi.completeBaseName()));
+	else {
+		QVector<OutputImage> images = outputImages(params, params.out_dir, fi.completeBaseName(), outExt(fi));
+		for (QVector<OutputImage>::ConstIterator it = images.begin(); it != images.end(); ++it)
+			files.append(it->fn);
+		if (params.removeCellEdges && params.removedCellEdgesPreview)
+			files.append(QString("%1/%2_no_edges.%3").arg(params.out_dir).arg(fi.completeBaseName()).arg(outExt(fi)));
+	}
+	return files;
+}
+
+cv::Mat AlgorithmWorker::readThumbnail(const QString& fn, int size) {
+	cv::Mat gray;
+	if (QFileInfo(fn).suffix().toLower() == "lsm") {
+		gray = readLSM(fn, true);
+		if (gray.empty())
+			gray = readLSM(fn);
+	}
+	else // jpegs are decoded at 1/4 of the size right away
+		gray = cv::imread(fn.toStdString(), cv::IMREAD_REDUCED_GRAYSCALE_4);
+	if (gray.empty()) return gray;
+
+	double scale = std::min(1.0, size / static_cast<double>(std::max(gray.cols, gray.rows)));
+	if (scale == 1.0) return gray;
+	cv::Mat thumbnail;
+	cv::resize(gray, thumbnail, cv::Size(), scale, scale, cv::INTER_AREA);
+	return thumbnail;
+}
+
+cv::Mat AlgorithmWorker::readLSM(const QString& fn, bool thumbnail) {
 	// get file handle
 	FILE* flsm;
-	fopen_s(&flsm, _image.toStdString().c_str(), "rb");
+	fopen_s(&flsm, fn.toStdString().c_str(), "rb");
 	if (!flsm) return cv::Mat();
 
 	// parse .lsm file
@@ -87,218 +316,236 @@ cv::Mat AlgorithmWorker::readLSM() {
 		return cv::Mat();
 	}
 
-	// verify if there is any IFD and any strip
-	if (lsm->ifd_length == 0) return cv::Mat();
-	if (lsm->ifd[0].tag_strip_offsets_length == 0) return cv::Mat();
-
-	// read raw pixels (8-bit grayscale)
-	struct tiff_ifd* ifd = &lsm->ifd[0];
-	void* pixels = lsm_read_pixel_data(flsm, ifd, 0);
-	if (!pixels) {
-		free(lsm);
+	// verify if there is a matching IFD with 8-bit samples and any strip
+	int ifd_idx = lsm_find_ifd(lsm, thumbnail);
+	struct tiff_ifd* ifd = ifd_idx >= 0 ? &lsm->ifd[ifd_idx] : NULL;
+	if (!ifd || ifd->tag_strip_offsets_length == 0 ||
+		(ifd->tag_bits_per_sample_length > 0 && ifd->tag_bits_per_sample[0] != 8)) {
+		lsm_free(lsm);
 		fclose(flsm);
+		return cv::Mat();
 	}
-	
+
+	// read raw pixels (8-bit), the first strip holds the first channel or all of them interleaved
+	size_t length = 0;
+	void* pixels = lsm_read_pixel_data(flsm, ifd, 0, &length);
+	fclose(flsm);
+	int channels = ifd->tag_planar_configuration != 2 && ifd->tag_samples_per_pixel == 3 ? 3 : 1;
+	int w = ifd->tag_image_width, h = ifd->tag_image_length;
+	lsm_free(lsm);
+	if (!pixels || length < static_cast<size_t>(w) * h * channels) {
+		free(pixels);
+		return cv::Mat();
+	}
+
 	// copy pixels data into new cv::Mat
-	cv::Mat gray = cv::Mat(ifd->tag_image_length, ifd->tag_image_width, CV_8UC1, pixels).clone();
+	cv::Mat gray;
+	if (channels == 3)
+		cv::cvtColor(cv::Mat(h, w, CV_8UC3, pixels), gray, cv::COLOR_RGB2GRAY);
+	else
+		gray = cv::Mat(h, w, CV_8UC1, pixels).clone();
 
 	// free & return
 	free(pixels);
-	free(lsm);
-	fclose(flsm);
 	return gray;
 }
 
-cv::Mat AlgorithmWorker::autoRotate(cv::Mat& gray) {
-	// blur
-	cv::Mat blurred;
-	cv::GaussianBlur(gray, blurred, cv::Size(0, 0), 3);
-#ifdef _DEBUG
-	imwrite((_params.out_dir + "/ar_1_GaussianBlur.png").toStdString(), blurred);
-#endif
+void AlgorithmWorker::autoRotate(Preprocessor& pre) {
+	// rotate the image to the weighted angle of the big pixel groups, if there are any,
+	// or keep it and rotate the lines classification instead
+	double angle;
+	if (pre.orientation(angle)) {
+		if (_params.rotateClassifier)
+			_angleOffset = static_cast<float>(angle);
+		else
+			pre.rotate(angle);
+	}
+}
 
+const cv::Mat& AlgorithmWorker::removeCellEdges(Preprocessor& pre, const QFileInfo& fi) {
 	// binarize
-	cv::Mat bin;
-	cv::adaptiveThreshold(blurred, bin, 255, cv::ADAPTIVE_THRESH_GAUSSIAN_C, cv::THRESH_BINARY, 19, -2);
-#ifdef _DEBUG
-	imwrite((_params.out_dir + "/ar_2_adaptiveThreshold.png").toStdString(), bin);
-#endif
-
-	// dilate, concates pixel groups
-	cv::Mat dilated;
-	int dilation_size = 3;
-	cv::Mat kernel = cv::getStructuringElement(cv::MORPH_ELLIPSE,
-		cv::Size(2 * dilation_size + 1, 2 * dilation_size + 1),
-		cv::Point(dilation_size, dilation_size));
-	cv::dilate(bin, dilated, kernel, cv::Point(-1, -1), 5);
-#ifdef _DEBUG
-	imwrite((_params.out_dir + "/ar_3_dilate.png").toStdString(), dilated);
-#endif
-
-	// find pixel groups contours
-	std::vector<std::vector<cv::Point> > contours;
-	std::vector<cv::Vec4i> hierarchy;
-	cv::findContours(dilated, contours, hierarchy, CV_RETR_EXTERNAL, CV_CHAIN_APPROX_SIMPLE);
-
-	// fit ellipses for big groups and check their angles
-	double wagedBeanFeretAngle = 0;
-	double totalArea = 0;
-	for (std::vector<std::vector<cv::Point> >::const_iterator it = contours.begin(); it != contours.end(); it++) {
-		if (it->size() > 314) { // 314 = radius of 50 pixels circle, 2 * pi * r
-			cv::RotatedRect r = cv::fitEllipse(*it);
-			if (r.angle > 90)
-				wagedBeanFeretAngle += (r.angle - 180) * r.size.area();
-			else if (r.angle < -90)
-				wagedBeanFeretAngle += (r.angle + 180) * r.size.area();
-			else
-				wagedBeanFeretAngle += r.angle * r.size.area();
-			totalArea += r.size.area();
-		}
-	}
-#ifdef _DEBUG
-	cv::Mat contoursImg(dilated.size(), dilated.type(), BLACK);
-	cv::Mat contoursEllipses(dilated.size(), CV_8UC3, BLACK);
-	cv::Mat inputEllipses;
-	cvtColor(gray, inputEllipses, CV_GRAY2RGB);
-	for (int i = 0; i < contours.size(); i++) {
-		if (contours[i].size() > 314) { // 314 = radius of 50 pixels circle, 2 * pi * r
-			cv::drawContours(contoursImg, contours, i, WHITE, 3);
-			cv::drawContours(contoursEllipses, contours, i, WHITE, 3);
-			cv::RotatedRect r = cv::fitEllipse(contours[i]);
-			cv::ellipse(contoursEllipses, r, cv::Vec3b(0, 0, 255), 3);
-			cv::ellipse(inputEllipses, r, cv::Vec3b(0, 0, 255), 3);
-		}
+	{
+		ScopedStage stage(Profiler::Threshold, _traceId, &_times);
+		pre.bin();
 	}
-	imwrite((_params.out_dir + "/ar_4_contours.png").toStdString(), contoursImg);
-	imwrite((_params.out_dir + "/ar_5_ellipses.png").toStdString(), contoursEllipses);
-#endif
+	ScopedStage stage(Profiler::RemoveCellEdges, _traceId, &_times);
 
-	if (totalArea == 0)
-		return gray;
+	// process using main algorithm
+	detectLines(_params.cellWalls, pre.bin(), &pre.edgeMask());
+	if (_shouldStop) return pre.bin();
 
-	// rotate
-	wagedBeanFeretAngle /= totalArea;
-	cv::Mat rotMat = cv::getRotationMatrix2D(cv::Point2f(gray.cols/2.0f, gray.rows/2.0f), wagedBeanFeretAngle, 1.0);
-	cv::Mat rotated;
-	cv::warpAffine(gray, rotated, rotMat, gray.size());
-#ifdef _DEBUG
-	cv::Mat ellipsesRotated;
-	cv::warpAffine(inputEllipses, ellipsesRotated, rotMat, inputEllipses.size());
-	imwrite((_params.out_dir + "/ar_6_ellipses_rotated.png").toStdString(), ellipsesRotated);
-#endif
+	// remove class1 and class3 lines (thickened) from binarized image
+	const cv::Mat& masked = pre.binWithoutEdges();
+
+	// preview of what was removed, goes into the container if there's one
+	if (_params.removedCellEdgesPreview && !_params.container) {
+		QString fn = QString("%1/%2_no_edges.%3").arg(_params.out_dir).arg(fi.completeBaseName()).arg(outExt(fi));
+		writeFile(fn, masked, _pool.helperThreads());
+	}
 
-	return rotated;
+	return masked;
 }
 
-cv::Mat AlgorithmWorker::removeCellEdges(cv::Mat& gray, const QFileInfo& fi) {
-	// binarize
-	cv::Mat bin;
-	cv::adaptiveThreshold(gray, bin, 255, cv::ADAPTIVE_THRESH_GAUSSIAN_C, cv::THRESH_BINARY, 19, -2);
+LinesOutput AlgorithmWorker::detectLines(const LinesParameters& params, const cv::Mat& bin, cv::Mat* edgeMask) {
+	LineDetector detector(params, _shouldStop, _params.out_dir.toStdString(), &_progress);
+	detector.setAngleOffset(_angleOffset);
+	detector.setEdgeMask(edgeMask);
+	detector.setCollectSegments(_params.segments != 0 && !edgeMask);
+	detector.setCandidateStore(_params.storeCandidates && !edgeMask ? &_candidates : NULL);
+	if (_params.timeBudgetMs > 0) {
+		// cell walls removal gets half of what's left, so the main pass always has some time
+		LineDetector::Clock::time_point now = LineDetector::Clock::now();
+		detector.setDeadline(edgeMask && _deadline > now ? now + (_deadline - now) / 2 : _deadline);
+	}
+	return detector.detect(bin);
+}
 
-	// process using main algorithm
-	LinesOutput output = detectLines(bin, _params.cellWalls);
-	if (_shouldStop) return bin;
-
-	// thicken the output lines for class1 and class3 by 1 pixel
-	cv::Mat dilated1, dilated3;
-	int dilation_size = 3;
-	cv::Mat kernel = cv::getStructuringElement(cv::MORPH_ELLIPSE,
-		cv::Size(2 * dilation_size + 1, 2 * dilation_size + 1),
-		cv::Point(dilation_size, dilation_size));
-	cv::dilate(output.color1, dilated1, kernel);
-	cv::dilate(output.color3, dilated3, kernel);
-
-	// split per channel
-	cv::Mat split1[3], split3[3];
-	cv::split(dilated1, split1);
-	cv::split(dilated3, split3);
-
-	// merge red and blue channels (which are now "white") and substract it from binarized image
-	cv::Mat merged, masked;
-	cv::add(split1[0], split3[2], merged);
-	cv::subtract(bin, merged, masked);
-	
-	// preview of what was removed
-	if (_params.removedCellEdgesPreview) {
+LinesOutput AlgorithmWorker::detectFused(Preprocessor& pre, const QFileInfo& fi) {
+	FusedDetector detector(_params.cellWalls, _params.mainAlgo, _shouldStop, &_progress);
+	detector.setAngleOffset(_angleOffset);
+	detector.setCollectSegments(_params.segments != 0);
+	detector.setCandidateStore(_params.storeCandidates ? &_candidates : NULL);
+	if (_params.timeBudgetMs > 0)
+		detector.setDeadline(_deadline);
+	LinesOutput output = detector.detect(pre);
+
+	// preview of what was left after removing the cell edges
+	if (_params.removedCellEdgesPreview && !_params.container && !pre.binWithoutEdges().empty()) {
 		QString fn = QString("%1/%2_no_edges.%3").arg(_params.out_dir).arg(fi.completeBaseName()).arg(outExt(fi));
-		imwrite(fn.toStdString(), masked);
+		writeFile(fn, pre.binWithoutEdges(), _pool.helperThreads());
 	}
+	return output;
+}
 
-	return masked;
+void AlgorithmWorker::writeFile(const QString& fn, const cv::Mat& img, int threads) {
+	// strips of tiffs are compressed in parallel and written as they are done, instead of one encode on this thread
+	QString ext = QFileInfo(fn).suffix().toLower();
+	if (ext == "tif" || ext == "tiff")
+		TiffWriter(fn.toStdString(), TiffWriter::Lzw, threads).addPage(img);
+	else
+		imwrite(fn.toStdString(), img);
 }
 
-AlgorithmWorker::LinesOutput AlgorithmWorker::detectLines(const cv::Mat& bin, const LinesParameters& params) {
-
-	LinesOutput output(bin);
-	float whiteCount = output.bin.count(WHITE);
-#ifdef _DEBUG
-	int dbgImgDumpIter[9];
-	for (int dd = 1; dd <= 9; dd++)
-		dbgImgDumpIter[dd-1] = dd * (params.iterations / 10);
-	imwrite(QString("%1/dl_%2_input.png")
-		.arg(_params.out_dir)
-		.arg(params.line_length)
-		.toStdString(), bin);
-#endif
+void AlgorithmWorker::writeImage(const QString& fn, const cv::Mat& img) {
+	ScopedStage stage(Profiler::Write, _traceId, &_times);
+	writeFile(fn, img, _pool.helperThreads());
+}
 
-	for (int i = 0; i < params.iterations; i++) {
-		if (_shouldStop) return output;
-		int x1 = rand() % bin.cols;
-		int y1 = rand() % bin.rows;
-		int x2, y2, angle;
-		do {
-			angle = rand() % 360;
-			x2 = x1 + params.line_length * cos(deg2rad(angle));
-			y2 = y1 + params.line_length * sin(deg2rad(angle));
-		} while ((x1 == x2 && y1 == y2)
-			|| x1 == x2
-			|| x1 < 0 || y1 < 0 || x2 < 0 || y2 < 0
-			|| x1 >= bin.cols || y1 >= bin.rows || x2 >= bin.cols || y2 >= bin.rows);
-
-		if (output.bin.coverage(x1, y1, x2, y2, params.line_thickness) > params.min_coverage) {
-
-			cv::Vec3b color;
-			if ((angle < params.angle1)
-				|| (angle >= 360 - params.angle1)
-				|| (angle >= 180 - params.angle1 && angle < 180 + params.angle1)) {
-				// class 1
-				color = params.color1;
-				output.color1.line(x1, y1, x2, y2, params.line_thickness, params.color1);
-			}
-			else if ((angle < params.angle2)
-				|| (angle >= 360 - params.angle2)
-				|| (angle >= 180 - params.angle2 && angle < 180 + params.angle2)) {
-				// class 2
-				color = params.color2;
-				output.color2.line(x1, y1, x2, y2, params.line_thickness, params.color2);
-			}
-			else {
-				color = params.color3;
-				output.color3.line(x1, y1, x2, y2, params.line_thickness, params.color3);
-			}
-			output.all.line(x1, y1, x2, y2, params.line_thickness, color);
+void AlgorithmWorker::writeImageWithSrc(const QString& fn, const cv::Mat& gray, const cv::Mat& mask) {
+	cv::Mat colorized;
+	{
+		ScopedStage stage(Profiler::Colorize, _traceId, &_times);
+		colorized = ColorizedImage(gray, mask);
+	}
+	writeImage(fn, colorized);
+}
+
+QVector<AlgorithmWorker::OutputImage> AlgorithmWorker::outputImages(const AlgorithmWorker::Parameters& params, const QString& outDir, const QString& baseName, const QString& ext) {
+	QVector<OutputImage> images;
+	const QString* names[] = { NULL, &params.class1_name, &params.class2_name, &params.class3_name };
+	const bool selected[][2] = {
+		{ params.output_combined_img, params.output_combined_img_with_src },
+		{ params.output_class1_img, params.output_class1_img_with_src },
+		{ params.output_class2_img, params.output_class2_img_with_src },
+		{ params.output_class3_img, params.output_class3_img_with_src }
+	};
+	for (int mask = 0; mask < 4; mask++) {
+		QString name = mask == 0 ? "combined" : *names[mask];
+		if (selected[mask][0]) {
+			OutputImage image = { QString("%1/%2_%3.%4").arg(outDir).arg(baseName).arg(name).arg(ext), mask, false };
+			images.append(image);
 		}
+		if (selected[mask][1]) {
+			OutputImage image = { QString("%1/%2_src_%3.%4").arg(outDir).arg(baseName).arg(name).arg(ext), mask, true };
+			images.append(image);
+		}
+	}
+	return images;
+}
 
-#ifdef _DEBUG		
-		for(int dd = 0; dd < 9; dd++)
-			if (i == dbgImgDumpIter[dd]) {
-				imwrite(QString("%1/dl_%2_%3.png")
-					.arg(_params.out_dir)
-					.arg(params.line_length)
-					.arg(i)
-					.toStdString(), output.all);
-				break;
-			}
-#endif
+void AlgorithmWorker::writeFailed(const QString& fn, const char* reason) {
+	printf("%s: %s\n", fn.toLocal8Bit().constData(), reason);
+	_progress.writeFailed.store(true, std::memory_order_relaxed);
+}
 
-		// cutoff
-		if (i % 100000 == 0) {
-			float nonWhiteCount = output.all.count(params.color1) + output.all.count(params.color2) + output.all.count(params.color3);
-			if (nonWhiteCount / (whiteCount + 1) >= 0.95) break;
+bool AlgorithmWorker::writeContainer(const QString& baseName, const LinesOutput& output, const cv::Mat& gray, const cv::Mat& noEdges) {
+	cv::Mat labels;
+	{
+		ScopedStage stage(Profiler::Colorize, _traceId, &_times);
+		labels = LabelMap::fromOutput(output, _params.mainAlgo);
+	}
+	ScopedStage stage(Profiler::Write, _traceId, &_times);
+	TiffWriter writer(containerName(_params.out_dir, baseName).toStdString(), static_cast<TiffWriter::Compression>(_params.container), _pool.helperThreads());
+	if (!writer.isOpen() || !writer.addPage(labels, "labels")) return false;
+
+	// pages are told apart by their order, so the source is there whenever the preview is
+	bool withSrc = !noEdges.empty() || _params.output_combined_img_with_src ||
+		_params.output_class1_img_with_src || _params.output_class2_img_with_src || _params.output_class3_img_with_src;
+	if (withSrc && !writer.addPage(gray, "source")) return false;
+	if (!noEdges.empty() && !writer.addPage(noEdges, "no_edges")) return false;
+	return true;
+}
+
+bool AlgorithmWorker::render(const QString& container, const AlgorithmWorker::Parameters& params) {
+	// pages: label map, source, cell edges removal preview
+	std::vector<cv::Mat> pages;
+	if (!cv::imreadmulti(container.toStdString(), pages, cv::IMREAD_UNCHANGED) || pages.empty()) return false;
+	const cv::Mat& labels = pages[0];
+	if (labels.type() != CV_8UC1) return false;
+
+	QFileInfo fi(container);
+	QString baseName = fi.completeBaseName();
+	if (baseName.endsWith("_lines")) baseName.chop(6);
+	QString outDir = params.out_dir.isEmpty() ? fi.absolutePath() : params.out_dir;
+
+	// run alone, all the cores go to the strips
+	int threads = WorkerPool::availableCores();
+	bool complete = true;
+	QVector<OutputImage> images = outputImages(params, outDir, baseName, "tif");
+	for (QVector<OutputImage>::ConstIterator it = images.begin(); it != images.end(); ++it) {
+		cv::Mat mask = it->mask == 0 ?
+			LabelMap::combinedImage(labels, params.mainAlgo) :
+			LabelMap::classImage(labels, it->mask - 1, params.mainAlgo.color(it->mask - 1));
+		if (it->withSrc) {
+			// written without the source
+			if (pages.size() < 2) {
+				complete = false;
+				continue;
+			}
+			writeFile(it->fn, ColorizedImage(pages[1], mask), threads);
 		}
+		else
+			writeFile(it->fn, mask, threads);
 	}
+	if (params.removedCellEdgesPreview && pages.size() > 2)
+		writeFile(QString("%1/%2_no_edges.tif").arg(outDir).arg(baseName), pages[2], threads);
+	return complete;
+}
 
-	return output;
+bool AlgorithmWorker::reclassify(const QString& candidates, const AlgorithmWorker::Parameters& params, Report& report) {
+	CandidateStore store;
+	if (!store.read(candidates.toStdString())) return false;
+	LinesOutput output = store.replay(params.mainAlgo);
+
+	QFileInfo fi(candidates);
+	QString baseName = fi.completeBaseName();
+	if (baseName.endsWith("_candidates")) baseName.chop(11);
+	// same path as journaled by the detection run, so resume matches it
+	QFileInfo source(QString::fromStdString(store.sourcePath()));
+	QString outDir = params.out_dir.isEmpty() ? fi.absolutePath() : params.out_dir;
+
+	// masks only, the source image is not stored
+	const cv::Mat* masks[] = { &output.all, &output.color1, &output.color2, &output.color3 };
+	QVector<OutputImage> images = outputImages(params, outDir, baseName, outExt(source));
+	for (QVector<OutputImage>::ConstIterator it = images.begin(); it != images.end(); ++it)
+		if (!it->withSrc)
+			writeFile(it->fn, *masks[it->mask], WorkerPool::availableCores());
+
+	int color1count = output.color1.count(params.mainAlgo.color1);
+	int color2count = output.color2.count(params.mainAlgo.color2);
+	int color3count = output.color3.count(params.mainAlgo.color3);
+	report.addResult(source, color1count, color2count, color3count, output.stats, StageTimes());
+	return params.mainAlgo.min_coverage >= store.coverageFloor();
 }
 
 void AlgorithmWorker::run() {
@@ -308,79 +555,104 @@ void AlgorithmWorker::run() {
 	QFileInfo fi(_image);
 	if (!fi.isReadable()) return;
 
+	// whole image span in the trace
+	_traceId = Profiler::registerImage(fi.fileName().toStdString());
+	ScopedStage imageStage(Profiler::Image, _traceId);
+	_deadline = LineDetector::Clock::now() + std::chrono::milliseconds(_params.timeBudgetMs);
+
 	// load image in grayscale
 	cv::Mat gray;
-	if (fi.suffix().toLower() == "lsm") { // handle Zeiss files as well
-		gray = readLSM();
+	{
+		ScopedStage stage(Profiler::Read, _traceId, &_times);
+		gray = readImage(_image);
 		if (gray.rows == 0) return;
-	} else
-		gray = cv::imread(_image.toStdString(), CV_LOAD_IMAGE_GRAYSCALE);
-#ifdef _DEBUG
+	}
+#ifdef BIOLINES_DEBUG_DUMPS
 	imwrite((_params.out_dir + "/1_grayscale.png").toStdString(), gray);
 #endif
 
+	// preprocessing graph, shares the intermediate results between the steps
+	Preprocessor pre(gray,
+		static_cast<Preprocessor::ThresholdBackend>(_params.thresholdBackend),
+		static_cast<Preprocessor::OrientationMethod>(_params.orientationMethod),
+		_params.out_dir.toStdString());
+
 	// rotate
-	if(_params.autoRotate)
-		gray = autoRotate(gray);
+	if (_params.autoRotate) {
+		ScopedStage stage(Profiler::AutoRotate, _traceId, &_times);
+		autoRotate(pre);
+	}
+	gray = pre.source();
 
-	// remove cell edges
+	// remove cell edges, in the same pass as the main algorithm if fused
+	bool fused = _params.removeCellEdges && _params.fusedDetection;
 	cv::Mat bin;
-	if (_params.removeCellEdges) {
-		bin = removeCellEdges(gray, fi);
+	if (_params.removeCellEdges && !fused) {
+		bin = removeCellEdges(pre, fi);
 		if (_shouldStop) return;
-	} else
-		cv::adaptiveThreshold(gray, bin, 255, cv::ADAPTIVE_THRESH_GAUSSIAN_C, cv::THRESH_BINARY, 19, -2);
-#ifdef _DEBUG
+	} else {
+		ScopedStage stage(Profiler::Threshold, _traceId, &_times);
+		bin = pre.bin();
+	}
+#ifdef BIOLINES_DEBUG_DUMPS
 	imwrite((_params.out_dir + "/2_bin.png").toStdString(), bin);
 #endif
 
 	// main algorithm
-	LinesOutput output = detectLines(bin, _params.mainAlgo);
+	LinesOutput output = [&]() {
+		ScopedStage stage(Profiler::DetectLines, _traceId, &_times);
+		if (fused)
+			return detectFused(pre, fi);
+		return detectLines(_params.mainAlgo, bin);
+	}();
 	if (_shouldStop) return;
 
-	// write output images
-	if (_params.output_combined_img) {
-		QString fn = QString("%1/%2_combined.%3").arg(_params.out_dir).arg(fi.completeBaseName()).arg(outExt(fi));
-		imwrite(fn.toStdString(), output.all);
-	}
-	if (_params.output_combined_img_with_src) {
-		ColorizedImage colorized(gray, output.all);
-		QString fn = QString("%1/%2_src_combined.%3").arg(_params.out_dir).arg(fi.completeBaseName()).arg(outExt(fi));
-		imwrite(fn.toStdString(), colorized);
-	}
-	if (_params.output_class1_img) {
-		QString fn = QString("%1/%2_%3.%4").arg(_params.out_dir).arg(fi.completeBaseName()).arg(_params.class1_name).arg(outExt(fi));
-		imwrite(fn.toStdString(), output.color1);
-	}
-	if (_params.output_class1_img_with_src) {
-		ColorizedImage colorized(gray, output.color1);
-		QString fn = QString("%1/%2_src_%3.%4").arg(_params.out_dir).arg(fi.completeBaseName()).arg(_params.class1_name).arg(outExt(fi));
-		imwrite(fn.toStdString(), colorized);
-	}
-	if (_params.output_class2_img) {
-		QString fn = QString("%1/%2_%3.%4").arg(_params.out_dir).arg(fi.completeBaseName()).arg(_params.class2_name).arg(outExt(fi));
-		imwrite(fn.toStdString(), output.color2);
-	}
-	if (_params.output_class2_img_with_src) {
-		ColorizedImage colorized(gray, output.color2);
-		QString fn = QString("%1/%2_src_%3.%4").arg(_params.out_dir).arg(fi.completeBaseName()).arg(_params.class2_name).arg(outExt(fi));
-		imwrite(fn.toStdString(), colorized);
+	// write output images, or the container they can be rendered from later
+	if (_params.container) {
+		cv::Mat noEdges;
+		if (_params.removeCellEdges && _params.removedCellEdgesPreview)
+			noEdges = pre.binWithoutEdges();
+		if (!writeContainer(fi.completeBaseName(), output, gray, noEdges))
+			writeFailed(containerName(_params.out_dir, fi.completeBaseName()));
+	} else {
+		const cv::Mat* masks[] = { &output.all, &output.color1, &output.color2, &output.color3 };
+		QVector<OutputImage> images = outputImages(_params, _params.out_dir, fi.completeBaseName(), outExt(fi));
+		for (QVector<OutputImage>::ConstIterator it = images.begin(); it != images.end(); ++it) {
+			if (it->withSrc)
+				writeImageWithSrc(it->fn, gray, *masks[it->mask]);
+			else
+				writeImage(it->fn, *masks[it->mask]);
+		}
 	}
-	if (_params.output_class3_img) {
-		QString fn = QString("%1/%2_%3.%4").arg(_params.out_dir).arg(fi.completeBaseName()).arg(_params.class3_name).arg(outExt(fi));
-		imwrite(fn.toStdString(), output.color3);
+
+	// accepted lines
+	if (_params.segments) {
+		ScopedStage stage(Profiler::Write, _traceId, &_times);
+		SegmentFile::Format format = static_cast<SegmentFile::Format>(_params.segments);
+		QString fn = QString("%1/%2_segments.%3").arg(_params.out_dir).arg(fi.completeBaseName()).arg(SegmentFile::extension(format));
+		if (!SegmentFile::fits(format, output.all.cols, output.all.rows))
+			writeFailed(fn, "image too large for the binary segments, use csv");
+		else if (!SegmentFile::write(fn.toStdString(), format, output.segments, output.all.cols, output.all.rows, _params.mainAlgo.line_thickness))
+			writeFailed(fn);
 	}
-	if (_params.output_class3_img_with_src) {
-		ColorizedImage colorized(gray, output.color3);
-		QString fn = QString("%1/%2_src_%3.%4").arg(_params.out_dir).arg(fi.completeBaseName()).arg(_params.class3_name).arg(outExt(fi));
-		imwrite(fn.toStdString(), colorized);
+
+	// candidates for reclassification
+	if (_params.storeCandidates) {
+		ScopedStage stage(Profiler::Write, _traceId, &_times);
+		_candidates.setSourcePath(fi.absoluteFilePath().toStdString());
+		QString fn = QString("%1/%2_candidates.bin").arg(_params.out_dir).arg(fi.completeBaseName());
+		if (!_candidates.fits())
+			writeFailed(fn, "image too large for the candidates store");
+		else if (!_candidates.write(fn.toStdString()))
+			writeFailed(fn);
 	}
 
 	// add line to the report file
 	int color1count = output.color1.count(_params.mainAlgo.color1);
 	int color2count = output.color2.count(_params.mainAlgo.color2);
 	int color3count = output.color3.count(_params.mainAlgo.color3);
-	_report.addResult(fi.fileName(), color1count, color2count, color3count);
-
-	emit finished();
+	// not journaled when some output is missing, so resume processes the image again
+	if (_progress.writeFailed.load(std::memory_order_relaxed))
+		return;
+	_report.addResult(fi, color1count, color2count, color3count, output.stats, _times);
 }
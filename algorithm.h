@@ -22,28 +22,19 @@
 
 #include <QThread>
 #include <QStack>
-#include "linableimg.h"
+#include <memory>
+#include <deque>
+#include "linedetector.h"
 #include "report.h"
+#include "preprocessor.h"
+#include "candidatestore.h"
+#include "workerpool.h"
 
 class AlgorithmWorker : public QObject, public QRunnable
 {
 	Q_OBJECT
 
 public:
-	struct LinesParameters {
-		// colors
-		cv::Vec3b color1, color2, color3;
-		// drawn line length
-		int line_length;
-		// how thick is the drawn line
-		int line_thickness;
-		// how many times we try to draw lines
-		int iterations;
-		// angles ranges for colors
-		int angle1, angle2;
-		// min white pixels under the line to keep it
-		float min_coverage;
-	};
 	struct Parameters {
 		// output directory
 		QString out_dir;
@@ -63,39 +54,98 @@ public:
 		bool output_class1_img, output_class1_img_with_src, output_class2_img, output_class2_img_with_src, output_class3_img, output_class3_img_with_src;
 		// classes names
 		QString class1_name, class2_name, class3_name;
+		// skip images which results are already in the journal
+		bool resume;
+		// worker threads, 0 - all available cores but one
+		int threads;
+		// worker threads pinned to the NUMA nodes, spread evenly
+		bool pinThreads;
+		// worker threads at background priority
+		bool lowPriority;
+		// wall-clock budget per image in ms, detection runs until cutoff or deadline instead of iterations, 0 - off
+		int timeBudgetMs;
+		// adaptive threshold implementation, Preprocessor::ThresholdBackend
+		int thresholdBackend;
+		// auto-rotation angle estimator, Preprocessor::OrientationMethod
+		int orientationMethod;
+		// auto-rotation applied to the lines angles when classifying them, the image is not warped
+		bool rotateClassifier;
+		// cell walls removal and main algorithm in a single pass
+		bool fusedDetection;
+		// all outputs of an image in one multi-page tiff instead of the separate images, TiffWriter::Compression, 0 - off
+		int container;
+		// accepted lines of the main algorithm written as segments, SegmentFile::Format, 0 - off
+		int segments;
+		// every candidate line of the main algorithm is stored, so the lines can be reclassified without the detection
+		bool storeCandidates;
+
+		// hash of the parameters which affect the results, used to match journaled results
+		QString hash() const;
 	};
 
 private:
-	bool& _shouldStop;
+	const std::atomic<bool>& _shouldStop;
 	const QString& _image;
 	const AlgorithmWorker::Parameters& _params;
 	Report& _report;
-
-	// main algorithm output
-	struct LinesOutput {
-		LinableImg 	bin, color1, color2, color3, all;
-
-		LinesOutput(const cv::Mat& bin) :
-			bin(bin),
-			color1(bin.size), color2(bin.size), color3(bin.size), all(bin.size) { }
-	};
+	// live progress of this image
+	ImageProgress& _progress;
+	// pool running this worker, tells how many threads the tiff strips may use
+	WorkerPool& _pool;
+	// id of the image in the trace
+	int _traceId;
+	// time spent in each stage for this image
+	StageTimes _times;
+	// end of the image time budget
+	LineDetector::Clock::time_point _deadline;
+	// auto-rotation angle applied to the lines classification instead of the image
+	float _angleOffset;
+	// candidates of the main algorithm, if stored
+	CandidateStore _candidates;
 
 public:
-	AlgorithmWorker(const QString& image, Report& report, const AlgorithmWorker::Parameters& params, bool& stopFlag) : 
-		_shouldStop(stopFlag), _image(image), _report(report), _params(params) {}
-	~AlgorithmWorker() {}
+	AlgorithmWorker(const QString& image, Report& report, const AlgorithmWorker::Parameters& params, const std::atomic<bool>& stopFlag, ImageProgress& progress, WorkerPool& pool) : 
+		_shouldStop(stopFlag), _image(image), _report(report), _params(params), _progress(progress), _pool(pool), _traceId(-1), _angleOffset(0) {}
+	// runnable is auto-deleted by the pool right after run, whichever way it returned
+	~AlgorithmWorker() {
+		_progress.done.store(true, std::memory_order_release);
+	}
 
-signals:
-	void finished();
+	// reads the image in grayscale, .lsm files as well, empty if it can't be read
+	static cv::Mat readImage(const QString& fn);
+	// reads a grayscale thumbnail fitting in size x size, from the embedded reduced-resolution image of .lsm files,
+	// other files are decoded downscaled, empty if it can't be read
+	static cv::Mat readThumbnail(const QString& fn, int size);
+	// images written for the input image, which the input formats match
+	static QStringList outputImageFiles(const AlgorithmWorker::Parameters& params, const QFileInfo& fi);
+
+	// renders the selected colored images from a container written by a previous run
+	static bool render(const QString& container, const AlgorithmWorker::Parameters& params);
+	// classifies the stored candidates with the angle ranges and coverage threshold of the params, writes the selected
+	// masks and adds the result to the report, false if the store misses lines for the coverage threshold
+	static bool reclassify(const QString& candidates, const AlgorithmWorker::Parameters& params, Report& report);
 
 protected:
 	void run() override;
 
 private:
-	// degrees to radians
-	static inline float deg2rad(float degrees) {
-		return (degrees * M_PI) / 180.0f;
+	// colored output image, of all classes together (mask 0) or of a class (mask 1-3), alone or on the source image
+	struct OutputImage {
+		QString fn;
+		int mask;
+		bool withSrc;
+	};
+	// the selected colored images
+	static QVector<OutputImage> outputImages(const AlgorithmWorker::Parameters& params, const QString& outDir, const QString& baseName, const QString& ext);
+
+	// container file name of the image
+	static inline QString containerName(const QString& outDir, const QString& baseName) {
+		return QString("%1/%2_lines.tif").arg(outDir).arg(baseName);
 	}
+	// writes the label map, the source if needed by the images rendered from it and the cell edges removal preview, false if any page can't be written
+	bool writeContainer(const QString& baseName, const LinesOutput& output, const cv::Mat& gray, const cv::Mat& noEdges);
+	// marks the image as not fully written, the batch status counts it, the console gets the file name and why
+	void writeFailed(const QString& fn, const char* reason = "can't write");
 
 	// lsm files we output as tif, other in same format as input image
 	static inline QString outExt(const QFileInfo& fi) {
@@ -104,14 +154,25 @@ private:
 		return fi.suffix();
 	}
 
-	// reads image in Zeiss confocal microscope format (.lsm)
-	cv::Mat readLSM();
+	// writes tiffs with TiffWriter, other formats with imwrite
+	static void writeFile(const QString& fn, const cv::Mat& img, int threads);
+	// writeFile timed as a separate trace event
+	void writeImage(const QString& fn, const cv::Mat& img);
+	// colorizes the gray image with the lines mask and writes it
+	void writeImageWithSrc(const QString& fn, const cv::Mat& gray, const cv::Mat& mask);
+
+	// runs the lines detection, within the time budget if set, cell walls detection draws the cell edges into the mask
+	LinesOutput detectLines(const LinesParameters& params, const cv::Mat& bin, cv::Mat* edgeMask = NULL);
+
+	// cell walls removal and main algorithm in a single pass
+	LinesOutput detectFused(Preprocessor& pre, const QFileInfo& fi);
+
+	// reads image in Zeiss confocal microscope format (.lsm), the full one or the embedded thumbnail
+	static cv::Mat readLSM(const QString& fn, bool thumbnail = false);
 	// auto-rotate the image to vertical position before processing
-	cv::Mat autoRotate(cv::Mat& gray);
+	void autoRotate(Preprocessor& pre);
 	// remove cell walls before processing, returns binary image
-	cv::Mat removeCellEdges(cv::Mat& gray, const QFileInfo& fi);
-	// main algorithm, used also in removeCellWalls
-	AlgorithmWorker::LinesOutput detectLines(const cv::Mat& bin, const LinesParameters& params);
+	const cv::Mat& removeCellEdges(Preprocessor& pre, const QFileInfo& fi);
 };
 
 class Algorithm : public QThread
@@ -119,14 +180,42 @@ class Algorithm : public QThread
 	Q_OBJECT
 
 private:
-	bool _shouldStop;
+	std::atomic<bool> _shouldStop;
 	QStringList _images;
 	AlgorithmWorker::Parameters _params;
+	// hot folder, images are processed as they are written into it until stopped
+	QString _watchDir;
+	// images found in the hot folder, workers keep references so they must not move
+	std::deque<QString> _watched;
 
 	// for estimating time left
 	QElapsedTimer _timer;
-	int _done;
 	Report _report;
+	// kept between the runs, recreated when the threads settings change
+	std::unique_ptr<WorkerPool> _pool;
+
+	// live progress, one per image, published by the workers, grows in watch mode
+	std::deque<ImageProgress> _progress;
+	// images already announced by imageFinished
+	std::vector<bool> _finished;
+	// planned detection iterations per image, all passes
+	long long _imageCost;
+	// previous sample, for the live throughput
+	long long _lastIterations;
+	qint64 _lastSampleMs, _lastStatusMs;
+
+	// how often the progress is sampled and how often the status line is emitted
+	static const int SAMPLE_INTERVAL_MS = 500;
+	static const int STATUS_INTERVAL_MS = 5000;
+
+	// computes batch progress, throughput and ETA from the workers counters
+	void sampleProgress();
+	// emits imageFinished for the images done since the last call
+	void emitFinishedImages();
+	// number of finished images with some output not written
+	int writeFailures() const;
+	// processes the hot folder images until stopped, the report is saved after every finished image
+	void watch(WorkerPool* pool);
 
 public:
 	Algorithm(QObject *parent = 0) : QThread(parent), _shouldStop(false) {}
@@ -135,9 +224,19 @@ public:
 	inline void start(const QStringList& images, const AlgorithmWorker::Parameters& params) {
 		if (isRunning()) return;
 		_images = images;
+		_watchDir.clear();
+		_params = params;
+		_shouldStop = false;
+		QThread::start();
+	}
+
+	// watch mode, runs until stopped
+	inline void start(const QString& watchDir, const AlgorithmWorker::Parameters& params) {
+		if (isRunning()) return;
+		_images.clear();
+		_watchDir = watchDir;
 		_params = params;
 		_shouldStop = false;
-		_done = 0;
 		QThread::start();
 	}
 
@@ -145,12 +244,18 @@ public:
 		_shouldStop = true;
 	}
 
-protected slots:
-	void workerFinished();
+	// results of the last run, valid when it's finished
+	inline const Report& report() const {
+		return _report;
+	}
 
 signals:
 	void progressMade(int progress);
 	void etaUpdated(const QString& eta);
+	// periodic one-line summary for the console
+	void statusUpdated(const QString& status);
+	// worker is done with the image, whether it succeeded or not, batch mode only
+	void imageFinished(const QString& image);
 
 protected:
 	void run() override;
@@ -0,0 +1,137 @@
+/*
+* BioLines (https://github.com/mmuszkow/BioLines)
+* Detection of filamentous structures in biological microscopic images
+* Copyright(C) 2017 Maciek Muszkowski
+*
+* This program is free software : you can redistribute it and / or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "stdafx.h"
+#include "biolines_api.h"
+#include "preprocessor.h"
+#include "linedetector.h"
+#include "fuseddetector.h"
+#include "labelmap.h"
+
+// the classes colors only tell the classes apart in LinesOutput, the caller gets counts and labels
+static const cv::Vec3b CLASS1(0, 0, 255), CLASS2(0, 255, 0), CLASS3(255, 0, 0);
+
+static LinesParameters linesParameters(const biolines_lines_params& p) {
+	LinesParameters params = {
+		CLASS1, CLASS2, CLASS3,
+		p.line_length,
+		p.line_thickness,
+		p.iterations,
+		p.angle1,
+		p.angle2,
+		p.min_coverage,
+		p.tolerance,
+		p.sampling_density
+	};
+	return params;
+}
+
+// vertical lines are never sampled, so a line fits from any start point only if it's shorter than half the width,
+// otherwise the angles would be redrawn forever, classes angles are ordered as in the GUI
+static bool valid(const biolines_lines_params& p, int width) {
+	return p.line_length > 1 && 2 * static_cast<long long>(p.line_length) < width && p.line_thickness > 0 && p.iterations >= 0 &&
+		p.angle1 >= 0 && p.angle1 <= p.angle2 && p.angle2 <= 90 && p.sampling_density >= 0;
+}
+
+int biolines_api_version(void) {
+	return BIOLINES_API_VERSION;
+}
+
+void biolines_default_params(biolines_params* params) {
+	if (!params) return;
+	// same as the GUI defaults
+	biolines_lines_params main = { 20, 1, 2000000, 30, 60, 0.7f, 0, 0 };
+	biolines_lines_params walls = { 100, 5, 2000000, 30, 60, 0.7f, 0, 0 };
+	params->main = main;
+	params->cell_walls = walls;
+	params->remove_cell_edges = 0;
+	params->fused = 0;
+	params->auto_rotate = 0;
+	params->threshold_backend = BIOLINES_THRESHOLD_GAUSSIAN;
+}
+
+int biolines_detect(
+	const uint8_t* pixels, int width, int height, ptrdiff_t stride,
+	const biolines_params* params,
+	biolines_result* result,
+	uint8_t* labels, ptrdiff_t labels_stride) {
+
+	if (!pixels || width <= 0 || height <= 0 || stride < width || !params || !result)
+		return BIOLINES_INVALID_ARGUMENT;
+	if (labels && labels_stride < width)
+		return BIOLINES_INVALID_ARGUMENT;
+	if (!valid(params->main, width) || (params->remove_cell_edges && !valid(params->cell_walls, width)))
+		return BIOLINES_INVALID_ARGUMENT;
+
+	try {
+		// caller's buffer, not copied
+		cv::Mat gray(height, width, CV_8UC1, const_cast<uint8_t*>(pixels), static_cast<size_t>(stride));
+		Preprocessor pre(gray, params->threshold_backend == BIOLINES_THRESHOLD_BOX ? Preprocessor::BoxThreshold : Preprocessor::GaussianThreshold);
+		LinesParameters main = linesParameters(params->main);
+		LinesParameters walls = linesParameters(params->cell_walls);
+		std::atomic<bool> stop(false);
+
+		// classification rotated instead of the image, so the image isn't copied
+		float angleOffset = 0;
+		double angle;
+		if (params->auto_rotate && pre.orientation(angle))
+			angleOffset = static_cast<float>(angle);
+
+		LinesOutput output = [&]() {
+			if (params->remove_cell_edges && params->fused) {
+				FusedDetector detector(walls, main, stop);
+				detector.setAngleOffset(angleOffset);
+				return detector.detect(pre);
+			}
+			const cv::Mat* bin = &pre.bin();
+			if (params->remove_cell_edges) {
+				LineDetector edges(walls, stop);
+				edges.setAngleOffset(angleOffset);
+				edges.setEdgeMask(&pre.edgeMask());
+				edges.detect(pre.bin());
+				bin = &pre.binWithoutEdges();
+			}
+			LineDetector detector(main, stop);
+			detector.setAngleOffset(angleOffset);
+			return detector.detect(*bin);
+		}();
+
+		// same as in the report
+		result->count[0] = output.color1.count(CLASS1);
+		result->count[1] = output.color2.count(CLASS2);
+		result->count[2] = output.color3.count(CLASS3);
+		float total = static_cast<float>(result->count[0] + result->count[1] + result->count[2]);
+		for (int i = 0; i < 3; i++)
+			result->percent[i] = total > 0 ? result->count[i] * 100.0f / total : 0.0f;
+		result->candidates = output.stats.candidates;
+		result->accepted = output.stats.accepted;
+		result->foreground = output.stats.foreground;
+
+		// written straight into caller's memory
+		if (labels) {
+			cv::Mat labelMap(height, width, CV_8UC1, labels, static_cast<size_t>(labels_stride));
+			LabelMap::fromOutput(output, main, labelMap);
+		}
+	}
+	catch (...) {
+		return BIOLINES_ERROR;
+	}
+	return BIOLINES_OK;
+}
@@ -0,0 +1,121 @@
+/*
+* BioLines (https://github.com/mmuszkow/BioLines)
+* Detection of filamentous structures in biological microscopic images
+* Copyright(C) 2017 Maciek Muszkowski
+*
+* This program is free software : you can redistribute it and / or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+/* In-process C API of the lines detection, works on caller's 8-bit grayscale buffers, without any file I/O,
+   results and the optional label map are written into caller's memory. Functions are thread-safe,
+   different images can be processed from different threads at the same time. */
+
+#ifndef BIOLINES_API_H
+#define BIOLINES_API_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef _WIN32
+#ifdef BIOLINES_API_EXPORTS
+#define BIOLINES_API __declspec(dllexport)
+#else
+#define BIOLINES_API __declspec(dllimport)
+#endif
+#else
+#define BIOLINES_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Increased when the structures below change. */
+#define BIOLINES_API_VERSION 1
+
+/* Return codes. */
+#define BIOLINES_OK                0
+#define BIOLINES_INVALID_ARGUMENT -1
+#define BIOLINES_ERROR            -2
+
+/* Label map bits, same as in the container files: bit 0-2 - lines of class 1-3 cover the pixel,
+   bits 4-5 - class shown on top in the combined image (1-3, 0 - none). */
+#define BIOLINES_LABEL_CLASSES_MASK   0x07
+#define BIOLINES_LABEL_COMBINED_SHIFT 4
+
+/* Threshold backends. */
+#define BIOLINES_THRESHOLD_GAUSSIAN 0
+#define BIOLINES_THRESHOLD_BOX      1
+
+/* Parameters of a detection pass, same meaning as the command line options. */
+struct biolines_lines_params {
+	/* Line length and thickness in pixels, the length must be less than half the image width. */
+	int line_length;
+	int line_thickness;
+	/* Number of candidate lines. */
+	int iterations;
+	/* Angles ranges of the classes, in degrees, 0 <= angle1 <= angle2 <= 90. */
+	int angle1, angle2;
+	/* Part of the line on the foreground to accept it, 0-1. */
+	float min_coverage;
+	/* Stop when the classes shares are known within this many percentage points, 0 - off. */
+	float tolerance;
+	/* Iterations scaled by the foreground, candidate line lengths per foreground pixel, 0 - off. */
+	float sampling_density;
+};
+
+struct biolines_params {
+	/* Main algorithm. */
+	struct biolines_lines_params main;
+	/* Cell walls detection, used if remove_cell_edges is set. */
+	struct biolines_lines_params cell_walls;
+	/* Remove the cell edges before the main algorithm, fused - in the same pass. */
+	int remove_cell_edges;
+	int fused;
+	/* Classify the lines relative to the estimated image orientation, the image is not rotated. */
+	int auto_rotate;
+	/* BIOLINES_THRESHOLD_*. */
+	int threshold_backend;
+};
+
+struct biolines_result {
+	/* Pixels covered by the lines of each class. */
+	int count[3];
+	/* Classes shares of the covered pixels, in %. */
+	float percent[3];
+	/* Main algorithm counters. */
+	int candidates, accepted, foreground;
+};
+
+/* BIOLINES_API_VERSION the library was built with. */
+BIOLINES_API int biolines_api_version(void);
+
+/* Fills the parameters with the program defaults. */
+BIOLINES_API void biolines_default_params(struct biolines_params* params);
+
+/* Detects the lines on the 8-bit grayscale image, @stride is the distance between rows in bytes.
+   The image is used in place and not modified. If @labels isn't NULL, the label map of the image size
+   is written into it, @labels_stride apart. Returns BIOLINES_OK or an error code. */
+BIOLINES_API int biolines_detect(
+	const uint8_t* pixels, int width, int height, ptrdiff_t stride,
+	const struct biolines_params* params,
+	struct biolines_result* result,
+	uint8_t* labels, ptrdiff_t labels_stride);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BIOLINES_API_H */
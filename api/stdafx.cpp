@@ -0,0 +1,23 @@
+/*
+* BioLines (https://github.com/mmuszkow/BioLines)
+* Detection of filamentous structures in biological microscopic images
+* Copyright(C) 2017 Maciek Muszkowski
+*
+* This program is free software : you can redistribute it and / or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "stdafx.h"
+
+const cv::Vec3b BLACK(0, 0, 0);
+const cv::Vec3b WHITE(255, 255, 255);
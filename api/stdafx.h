@@ -0,0 +1,30 @@
+/*
+* BioLines (https://github.com/mmuszkow/BioLines)
+* Detection of filamentous structures in biological microscopic images
+* Copyright(C) 2017 Maciek Muszkowski
+*
+* This program is free software : you can redistribute it and / or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// precompiled header of the API, the core sources include it as "stdafx.h", without Qt and OpenCV codecs
+// as the library does no I/O and links only opencv_core and opencv_imgproc
+
+// M_PI, Qt defines it in the main project
+#define _USE_MATH_DEFINES
+#include <cmath>
+#include <algorithm>
+#include "opencv2/core/core.hpp"
+#include "opencv2/imgproc/imgproc.hpp"
+
+extern const cv::Vec3b BLACK, WHITE;
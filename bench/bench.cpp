@@ -0,0 +1,375 @@
+/*
+* BioLines (https://github.com/mmuszkow/BioLines)
+* Detection of filamentous structures in biological microscopic images
+* Copyright(C) 2017 Maciek Muszkowski
+*
+* This program is free software : you can redistribute it and / or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Microbenchmarks of the detection hot paths, results are written as JSON
+// usage: BioLinesBench [input dir] [output .json]
+//        BioLinesBench --e2e [input dir] [output .json] [iterations per image]
+
+#include "stdafx.h"
+#include <chrono>
+#include <vector>
+#include <string>
+#include "linedetector.h"
+#include "colorizedimage.h"
+#include "lsm.h"
+#include "preprocessor.h"
+#include "tiffwriter.h"
+#include "candidatestore.h"
+#include <thread>
+
+typedef std::chrono::steady_clock Clock;
+
+// e2e.cpp
+int benchEndToEnd(int argc, char *argv[], const std::string& inDir, const std::string& outPath, int iterations);
+
+struct BenchResult {
+	std::string name;
+	std::string params;
+	double value;
+	std::string unit;
+};
+
+static std::vector<BenchResult> results;
+
+static inline double secondsSince(const Clock::time_point& start) {
+	return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static void report(const std::string& name, const std::string& params, double value, const std::string& unit) {
+	BenchResult res = { name, params, value, unit };
+	results.push_back(res);
+	printf("%-16s %-32s %14.2f %s\n", name.c_str(), params.c_str(), value, unit.c_str());
+}
+
+// same binarization as in the main algorithm
+static cv::Mat binarize(const cv::Mat& gray) {
+	return Preprocessor(gray, Preprocessor::GaussianThreshold).bin().clone();
+}
+
+// both threshold backends, with the share of pixels which differ from the Gaussian one
+static void benchThreshold(const cv::Mat& gray) {
+	const int repeat = 10;
+	const char* names[] = { "gaussian", "box" };
+	cv::Mat reference;
+	for (int backend = Preprocessor::GaussianThreshold; backend <= Preprocessor::BoxThreshold; backend++) {
+		Preprocessor pre(gray, static_cast<Preprocessor::ThresholdBackend>(backend));
+		cv::Mat bin;
+		Clock::time_point start = Clock::now();
+		for (int i = 0; i < repeat; i++)
+			pre.threshold(gray, bin);
+		double mpx = gray.rows * static_cast<double>(gray.cols) * repeat / 1e6;
+		report("threshold", std::string("backend=") + names[backend], mpx / secondsSince(start), "Mpx/s");
+
+		if (backend == Preprocessor::GaussianThreshold)
+			reference = bin;
+		else
+			report("threshold", std::string("backend=") + names[backend] + " differing",
+				cv::countNonZero(bin != reference) * 100.0 / bin.total(), "%");
+	}
+}
+
+// random valid candidates, generated the same way as in LineDetector
+struct Candidate {
+	int x1, y1, x2, y2;
+};
+
+static std::vector<Candidate> candidates(const cv::Mat& img, int length, size_t count) {
+	std::vector<Candidate> res;
+	res.reserve(count);
+	srand(42);
+	while (res.size() < count) {
+		Candidate c;
+		c.x1 = rand() % img.cols;
+		c.y1 = rand() % img.rows;
+		float angle = (rand() % 360) * static_cast<float>(M_PI) / 180.0f;
+		c.x2 = c.x1 + static_cast<int>(length * cos(angle));
+		c.y2 = c.y1 + static_cast<int>(length * sin(angle));
+		if (c.x1 == c.x2 || c.x2 < 0 || c.y2 < 0 || c.x2 >= img.cols || c.y2 >= img.rows) continue;
+		res.push_back(c);
+	}
+	return res;
+}
+
+// max difference of the moments angle from the ellipses fitting one, in degrees
+static const double ORIENTATION_TOLERANCE = 2.0;
+
+// both auto-rotation angle estimators, the moments one is checked against the ellipses fitting, false if it's off
+static bool benchOrientation(const std::vector<cv::String>& images) {
+	bool ok = true;
+	const char* names[] = { "ellipseFit", "moments" };
+	for (const cv::String& path : images) {
+		cv::Mat gray = cv::imread(path, CV_LOAD_IMAGE_GRAYSCALE);
+		if (gray.empty()) continue;
+		std::string name = path.substr(path.find_last_of("/\\") + 1);
+		double angles[2] = { 0, 0 };
+		for (int method = Preprocessor::EllipseFit; method <= Preprocessor::Moments; method++) {
+			// new preprocessor every time, it caches the result
+			const int repeat = 3;
+			Clock::time_point start = Clock::now();
+			for (int i = 0; i < repeat; i++) {
+				Preprocessor pre(gray, Preprocessor::GaussianThreshold, static_cast<Preprocessor::OrientationMethod>(method));
+				pre.orientation(angles[method]);
+			}
+			report("orientation", name + " method=" + names[method], secondsSince(start) * 1000 / repeat, "ms/image");
+		}
+		// angles are axes, so 90 and -90 are the same
+		double difference = fabs(angles[Preprocessor::Moments] - angles[Preprocessor::EllipseFit]);
+		difference = std::min(difference, 180 - difference);
+		report("orientation", name + " difference", difference, "deg");
+		if (difference > ORIENTATION_TOLERANCE) {
+			fprintf(stderr, "%s: moments angle %.2f differs from ellipses fitting angle %.2f by more than %.1f deg\n",
+				name.c_str(), angles[Preprocessor::Moments], angles[Preprocessor::EllipseFit], ORIENTATION_TOLERANCE);
+			ok = false;
+		}
+	}
+	return ok;
+}
+
+static void benchCoverageAndLine(const cv::Mat& bin) {
+	const int lengths[] = { 10, 20, 50, 100 };
+	const int thicknesses[] = { 1, 3, 5 };
+	const size_t count = 200000;
+	for (int length : lengths) {
+		std::vector<Candidate> cands = candidates(bin, length, count);
+		for (int thickness : thicknesses) {
+			std::string params = "length=" + std::to_string(length) + " thickness=" + std::to_string(thickness);
+
+			LinableImg img(bin);
+			volatile float sink = 0;
+			Clock::time_point start = Clock::now();
+			for (const Candidate& c : cands)
+				sink = sink + img.coverage(c.x1, c.y1, c.x2, c.y2, thickness);
+			report("coverage", params, secondsSince(start) * 1e9 / count, "ns/candidate");
+
+			LinableImg canvas(bin.size);
+			start = Clock::now();
+			for (const Candidate& c : cands)
+				canvas.line(c.x1, c.y1, c.x2, c.y2, thickness, WHITE);
+			report("line", params, secondsSince(start) * 1e9 / count, "ns/candidate");
+		}
+	}
+}
+
+static LinesOutput benchDetectLines(const cv::Mat& bin) {
+	LinesParameters params = {
+		cv::Vec3b(0, 0xFF, 0), cv::Vec3b(0, 0xFF, 0xFF), cv::Vec3b(0, 0, 0xFF),
+		20, 1, 500000, 30, 60, 0.7f, 0, 0
+	};
+	std::atomic<bool> stop(false);
+	srand(42);
+	Clock::time_point start = Clock::now();
+	LinesOutput output = LineDetector(params, stop).detect(bin);
+	double secs = secondsSince(start);
+	report("detectLines", "length=20 thickness=1", output.stats.candidates / secs, "iterations/s");
+	return output;
+}
+
+// reclassification from stored candidates against the detection it replaces
+static void benchReclassify(const cv::Mat& bin) {
+	LinesParameters params = {
+		cv::Vec3b(0, 0xFF, 0), cv::Vec3b(0, 0xFF, 0xFF), cv::Vec3b(0, 0, 0xFF),
+		20, 1, 500000, 30, 60, 0.7f, 0, 0
+	};
+	std::atomic<bool> stop(false);
+	CandidateStore store;
+	LineDetector detector(params, stop);
+	detector.setCandidateStore(&store);
+	srand(42);
+	detector.detect(bin);
+
+	LinesParameters changed = params;
+	changed.angle1 = 20;
+	changed.min_coverage = 0.8f;
+	const int repeat = 5;
+	Clock::time_point start = Clock::now();
+	for (int i = 0; i < repeat; i++)
+		store.replay(changed);
+	report("reclassify", "length=20 thickness=1 500k", secondsSince(start) * 1000 / repeat, "ms/image");
+}
+
+static void benchCount(const LinableImg& img) {
+	const int repeat = 20;
+	volatile int sink = 0;
+	Clock::time_point start = Clock::now();
+	for (int i = 0; i < repeat; i++)
+		sink = sink + img.count(WHITE);
+	double mpx = img.rows * static_cast<double>(img.cols) * repeat / 1e6;
+	report("count", std::to_string(img.cols) + "x" + std::to_string(img.rows), mpx / secondsSince(start), "Mpx/s");
+}
+
+static void benchColorizedImage(const cv::Mat& gray, const cv::Mat& mask) {
+	const int repeat = 10;
+	Clock::time_point start = Clock::now();
+	for (int i = 0; i < repeat; i++)
+		ColorizedImage colorized(gray, mask);
+	double mpx = gray.rows * static_cast<double>(gray.cols) * repeat / 1e6;
+	report("ColorizedImage", std::to_string(gray.cols) + "x" + std::to_string(gray.rows), mpx / secondsSince(start), "Mpx/s");
+}
+
+// writing of a colored output image, OpenCV encoder against TiffWriter on one and on all cores
+static void benchTiffWrite(const cv::Mat& img) {
+	const int repeat = 5;
+	const std::string fn = "bench_write.tif";
+	double mb = img.total() * img.elemSize() * static_cast<double>(repeat) / 1e6;
+	std::string size = std::to_string(img.cols) + "x" + std::to_string(img.rows);
+
+	Clock::time_point start = Clock::now();
+	for (int i = 0; i < repeat; i++)
+		cv::imwrite(fn, img);
+	report("imwrite tif", size, mb / secondsSince(start), "MB/s");
+
+	int cores = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+	std::vector<int> threadCounts(1, 1);
+	if (cores > 1) threadCounts.push_back(cores);
+	for (int threads : threadCounts) {
+		start = Clock::now();
+		for (int i = 0; i < repeat; i++)
+			TiffWriter(fn, TiffWriter::Lzw, threads).addPage(img);
+		report("TiffWriter lzw", size + " " + std::to_string(threads) + " threads", mb / secondsSince(start), "MB/s");
+	}
+	remove(fn.c_str());
+}
+
+// Image-23.lsm is stored uncompressed, so its pixels are LZW encoded first and then the decoding is measured
+static void benchLzwDecode(const std::string& lsmPath) {
+	FILE* f = fopen(lsmPath.c_str(), "rb");
+	if (!f) {
+		fprintf(stderr, "Can't open %s\n", lsmPath.c_str());
+		return;
+	}
+	struct lsm_file* lsm = lsm_open(f);
+	if (!lsm || lsm->ifd_length == 0) {
+		fclose(f);
+		return;
+	}
+	struct tiff_ifd* ifd = &lsm->ifd[0];
+	size_t length = 0;
+	void* pixels = lsm_read_pixel_data(f, ifd, 0, &length);
+	fclose(f);
+	if (!pixels) {
+		lsm_free(lsm);
+		return;
+	}
+
+	struct lzw_buff* raw = lzw_buff_alloc(1, length);
+	memcpy(&raw->data, pixels, length);
+	struct lzw_buff* enc = lzw_encode(raw, 12);
+
+	const int repeat = 20;
+	Clock::time_point start = Clock::now();
+	for (int i = 0; i < repeat; i++)
+		free(lzw_decode(enc));
+	report("lzw_decode", "Image-23.lsm ch0", length * static_cast<double>(repeat) / 1e6 / secondsSince(start), "MB/s");
+
+	free(enc);
+	free(raw);
+	free(pixels);
+	lsm_free(lsm);
+}
+
+// BitsPerSample of a single channel is stored in the IFD entry itself, of 3 channels out of it, false if lsm_open misreads it
+static bool checkLsmBitsPerSample() {
+	const std::string fn = "bench_bits.lsm";
+	bool ok = true;
+	for (int channels = 1; channels <= 3; channels += 2) {
+		cv::Mat img(16, 16, CV_8UC(channels), cv::Scalar::all(128));
+		bool read = TiffWriter(fn, TiffWriter::NoCompression).addPage(img);
+		FILE* f = read ? fopen(fn.c_str(), "rb") : NULL;
+		struct lsm_file* lsm = f ? lsm_open(f) : NULL;
+		int ifd_idx = lsm ? lsm_find_ifd(lsm, false) : -1;
+		read = ifd_idx >= 0 && lsm->ifd[ifd_idx].tag_bits_per_sample_length == static_cast<uint32_t>(channels);
+		for (int channel = 0; read && channel < channels; channel++)
+			read = lsm->ifd[ifd_idx].tag_bits_per_sample[channel] == 8;
+		if (!read) {
+			fprintf(stderr, "lsm_open misreads BitsPerSample of %d channel image\n", channels);
+			ok = false;
+		}
+		if (lsm) lsm_free(lsm);
+		if (f) fclose(f);
+	}
+	remove(fn.c_str());
+	return ok;
+}
+
+static std::string jsonEscape(const std::string& str) {
+	std::string res;
+	for (char c : str) {
+		if (c == '"' || c == '\\') res += '\\';
+		res += c;
+	}
+	return res;
+}
+
+static bool saveJson(const std::string& path, const std::string& fixture) {
+	FILE* f = fopen(path.c_str(), "w");
+	if (!f) return false;
+	fprintf(f, "{\n  \"fixture\": \"%s\",\n  \"benchmarks\": [\n", jsonEscape(fixture).c_str());
+	for (size_t i = 0; i < results.size(); i++)
+		fprintf(f, "    { \"name\": \"%s\", \"params\": \"%s\", \"value\": %.3f, \"unit\": \"%s\" }%s\n",
+			jsonEscape(results[i].name).c_str(), jsonEscape(results[i].params).c_str(), results[i].value, jsonEscape(results[i].unit).c_str(),
+			i + 1 < results.size() ? "," : "");
+	fprintf(f, "  ]\n}\n");
+	fclose(f);
+	return true;
+}
+
+int main(int argc, char *argv[]) {
+	// whole pipeline
+	if (argc > 1 && std::string(argv[1]) == "--e2e") {
+		std::string inDir = argc > 2 ? argv[2] : "in";
+		std::string outPath = argc > 3 ? argv[3] : "bench_e2e.json";
+		int iterations = argc > 4 ? atoi(argv[4]) : 200000;
+		return benchEndToEnd(argc, argv, inDir, outPath, iterations);
+	}
+
+	std::string inDir = argc > 1 ? argv[1] : "in";
+	std::string outPath = argc > 2 ? argv[2] : "bench.json";
+
+	// fixtures from the bundled images
+	std::vector<cv::String> tifs;
+	cv::glob(inDir + "/MAX_Image*.tif", tifs);
+	if (tifs.empty()) {
+		fprintf(stderr, "No fixtures in %s\n", inDir.c_str());
+		return 1;
+	}
+	cv::Mat gray = cv::imread(tifs[0], CV_LOAD_IMAGE_GRAYSCALE);
+	if (gray.empty()) {
+		fprintf(stderr, "Can't read %s\n", tifs[0].c_str());
+		return 1;
+	}
+	cv::Mat bin = binarize(gray);
+	printf("Fixture %s (%dx%d)\n", tifs[0].c_str(), gray.cols, gray.rows);
+
+	benchThreshold(gray);
+	bool orientationOk = benchOrientation(tifs);
+	benchCoverageAndLine(bin);
+	LinesOutput output = benchDetectLines(bin);
+	benchReclassify(bin);
+	benchCount(output.all);
+	benchColorizedImage(gray, output.all);
+	benchTiffWrite(ColorizedImage(gray, output.all));
+	benchLzwDecode(inDir + "/Image-23.lsm");
+	bool lsmOk = checkLsmBitsPerSample();
+
+	if (!saveJson(outPath, tifs[0])) {
+		fprintf(stderr, "Can't write %s\n", outPath.c_str());
+		return 1;
+	}
+	return orientationOk && lsmOk ? 0 : 1;
+}
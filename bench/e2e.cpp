@@ -0,0 +1,156 @@
+/*
+* BioLines (https://github.com/mmuszkow/BioLines)
+* Detection of filamentous structures in biological microscopic images
+* Copyright(C) 2017 Maciek Muszkowski
+*
+* This program is free software : you can redistribute it and / or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// End-to-end batch throughput over the input corpus, with different thread counts and preprocessing options
+
+#include "stdafx.h"
+#include <chrono>
+#include <string>
+#include "algorithm.h"
+#include "profiler.h"
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+// peak resident memory of the whole process so far
+static double peakRssMB() {
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return counters.PeakWorkingSetSize / (1024.0 * 1024.0);
+	return 0;
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) == 0)
+		return usage.ru_maxrss / 1024.0;
+	return 0;
+#endif
+}
+
+int benchEndToEnd(int argc, char *argv[], const std::string& inDir, const std::string& outPath, int iterations) {
+	QCoreApplication app(argc, argv);
+
+	// whole corpus, sorted so the runs are comparable
+	QDir dir(QString::fromStdString(inDir));
+	QStringList images;
+	QFileInfoList files = dir.entryInfoList(QStringList() << "*.tif" << "*.lsm", QDir::Files, QDir::Name);
+	for (QFileInfoList::ConstIterator it = files.begin(); it != files.end(); ++it)
+		images.append(it->absoluteFilePath());
+	if (images.isEmpty()) {
+		fprintf(stderr, "No images in %s\n", inDir.c_str());
+		return 1;
+	}
+
+	QString outDir = QDir::temp().filePath("BioLinesBench");
+	QDir().mkpath(outDir);
+
+	LinesParameters cellWalls = {
+		cv::Vec3b(0xFF, 0, 0), cv::Vec3b(0, 0xFF, 0), cv::Vec3b(0, 0, 0xFF),
+		100, 5, iterations, 30, 60, 0.7f, 0, 0
+	};
+	LinesParameters mainAlgo = {
+		cv::Vec3b(0, 0xFF, 0), cv::Vec3b(0, 0xFF, 0xFF), cv::Vec3b(0, 0, 0xFF),
+		20, 1, iterations, 30, 60, 0.7f, 0, 0
+	};
+	AlgorithmWorker::Parameters params = {
+		outDir, cellWalls, mainAlgo,
+		false, false, false, // preprocessing, set below
+		true, false, // combined output only, so the writing stage is measured as well
+		false, false, false, false, false, false,
+		"Transverse", "Oblique", "Longitudinal",
+		false, 1, false, false, 0, Preprocessor::GaussianThreshold, Preprocessor::EllipseFit, false, false, 0, 0, false
+	};
+
+	// 1, 2, 4 ... and all cores
+	std::vector<int> threadCounts;
+	int cores = WorkerPool::availableCores();
+	for (int t = 1; t < cores; t *= 2)
+		threadCounts.push_back(t);
+	threadCounts.push_back(cores);
+
+	struct Preprocessing {
+		const char* name;
+		bool autoRotate, removeCellEdges;
+	} preprocessings[] = {
+		{ "none", false, false },
+		{ "autoRotate", true, false },
+		{ "removeCellEdges", false, true },
+		{ "autoRotate+removeCellEdges", true, true }
+	};
+
+	printf("%d images, %d iterations per image\n", images.size(), iterations);
+	QJsonArray runs;
+	for (const Preprocessing& pre : preprocessings) {
+		params.autoRotate = pre.autoRotate;
+		params.removeCellEdges = pre.removeCellEdges;
+		double singleThreadThroughput = 0;
+		for (int threads : threadCounts) {
+			params.threads = threads;
+			Profiler::reset();
+
+			Algorithm algo;
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			algo.start(images, params);
+			algo.wait();
+			double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+			double throughput = images.size() / secs;
+			if (threads == 1) singleThreadThroughput = throughput;
+			double efficiency = singleThreadThroughput > 0 ? throughput / (threads * singleThreadThroughput) : 0;
+
+			// stage shares of the summed worker time
+			double stagesTotal = 0;
+			for (int s = 0; s < Profiler::STAGES; s++)
+				stagesTotal += Profiler::total(static_cast<Profiler::Stage>(s));
+			QJsonObject shares;
+			for (int s = 0; s < Profiler::STAGES; s++) {
+				Profiler::Stage stage = static_cast<Profiler::Stage>(s);
+				shares[Profiler::stageName(stage)] = stagesTotal > 0 ? Profiler::total(stage) / stagesTotal : 0;
+			}
+
+			QJsonObject run;
+			run["preprocessing"] = pre.name;
+			run["threads"] = threads;
+			run["seconds"] = secs;
+			run["imagesPerSecond"] = throughput;
+			run["parallelEfficiency"] = efficiency;
+			run["peakRssMB"] = peakRssMB();
+			run["stageShares"] = shares;
+			runs.append(run);
+
+			printf("%-28s %3d threads %8.3f img/s  efficiency %5.2f  peak RSS %8.1f MB\n",
+				pre.name, threads, throughput, efficiency, peakRssMB());
+		}
+	}
+
+	QJsonObject root;
+	root["images"] = images.size();
+	root["iterations"] = iterations;
+	root["runs"] = runs;
+	QFile out(QString::fromStdString(outPath));
+	if (!out.open(QIODevice::WriteOnly)) {
+		fprintf(stderr, "Can't write %s\n", outPath.c_str());
+		return 1;
+	}
+	out.write(QJsonDocument(root).toJson());
+	return 0;
+}
@@ -19,9 +19,12 @@
 
 #include "stdafx.h"
 #include "biolines2.h"
+#include "tiffwriter.h"
+#include "segmentfile.h"
+#include "jobserver.h"
 
 BioLines2::BioLines2(QWidget *parent)
-	: QMainWindow(parent), algo(parent), saveSettingsOnQuit(true), closeOnFinish(false)
+	: QMainWindow(parent), algo(parent), saveSettingsOnQuit(true), closeOnFinish(false), resume(false), threads(0), pinThreads(false), lowPriority(false), timeBudgetMs(0), tolerance(0), samplingDensity(0), thresholdBackend(Preprocessor::GaussianThreshold), orientationMethod(Preprocessor::EllipseFit), rotateClassifier(false), fusedDetection(false), container(0), segments(0), storeCandidates(false), printStatus(false), previewStarted(false)
 {
 	ui.setupUi(this);
 
@@ -62,9 +65,27 @@ BioLines2::BioLines2(QWidget *parent)
 	// algorithm
 	connect(&algo, &Algorithm::progressMade, ui.progressBar, &QProgressBar::setValue);
 	connect(&algo, &Algorithm::etaUpdated, ui.etaLabel, &QLabel::setText);
+	connect(&algo, &Algorithm::statusUpdated, this, &BioLines2::printStatusLine);
 	connect(&algo, &Algorithm::finished, this, &BioLines2::onAlgoFinished);
 	connect(ui.runButton, &QPushButton::clicked, this, &BioLines2::startStopAlgorithm);
 
+	// live preview, restarted on every parameter change
+	connect(ui.previewImageComboBox, static_cast<void (QComboBox::*)(int)>(&QComboBox::currentIndexChanged), this, &BioLines2::updatePreview);
+	connect(ui.lineLengthSpinBox, static_cast<void (QSpinBox::*)(int)>(&QSpinBox::valueChanged), this, &BioLines2::updatePreview);
+	connect(ui.lineThicknessSpinBox, static_cast<void (QSpinBox::*)(int)>(&QSpinBox::valueChanged), this, &BioLines2::updatePreview);
+	connect(ui.iterationsSpinBox, static_cast<void (QSpinBox::*)(int)>(&QSpinBox::valueChanged), this, &BioLines2::updatePreview);
+	connect(ui.coverageSpinBox, static_cast<void (QSpinBox::*)(int)>(&QSpinBox::valueChanged), this, &BioLines2::updatePreview);
+	connect(ui.colorTreshold1SpinBox, static_cast<void (QSpinBox::*)(int)>(&QSpinBox::valueChanged), this, &BioLines2::updatePreview);
+	connect(ui.colorTreshold2SpinBox, static_cast<void (QSpinBox::*)(int)>(&QSpinBox::valueChanged), this, &BioLines2::updatePreview);
+	connect(ui.class1ColorButton, &ColorButton::colorChanged, this, &BioLines2::updatePreview);
+	connect(ui.class2ColorButton, &ColorButton::colorChanged, this, &BioLines2::updatePreview);
+	connect(ui.class3ColorButton, &ColorButton::colorChanged, this, &BioLines2::updatePreview);
+	connect(&previewDetector, &PreviewDetector::previewReady, this, &BioLines2::showPreview);
+
+	// thumbnails of the selected images, clicking one previews it
+	ui.imagesListView->setModel(&thumbnails);
+	connect(ui.imagesListView, &QListView::clicked, [this](const QModelIndex& index) { ui.previewImageComboBox->setCurrentIndex(index.row()); });
+
 	readSettings();
 }
 
@@ -107,7 +128,26 @@ void BioLines2::setArgs(const QStringList& args) {
 						outputClass3WithSrcOption("outputClass3WithSrc", "Output 3rd class on source image"),
 						autoStartOption("autoStart", "Start algorithm at program start"),
 						autoCloseOption("autoClose", "Close the program when the algorithm finishes"),
-						noSaveOption("noSave", "Don't restore parameters values on next program run");
+						noSaveOption("noSave", "Don't restore parameters values on next program run"),
+						resumeOption("resume", "Skip images which results with same parameters are already in the output directory journal, unless they changed since"),
+						threadsOption("threads", "Number of worker threads, all available cores but one by default", "number"),
+						pinOption("pin", "Pin worker threads to the NUMA nodes, spread evenly, so the image buffers stay in local memory"),
+						lowPriorityOption("lowPriority", "Run worker threads at background priority"),
+						statusOption("status", "Print periodic progress status lines to the standard output"),
+						timeBudgetOption("timeBudget", "Time budget per image, lines are detected until the deadline instead of for the set number of iterations", "ms"),
+						toleranceOption("tolerance", "Stop detecting lines when the classes shares are known within this many percentage points (95% confidence)", "percent"),
+						densityOption("density", "Scale the iterations per image, number of candidate lines lengths per foreground pixel", "density"),
+						boxThresholdOption("boxThreshold", "Binarize with box mean window instead of Gaussian weighted one, faster"),
+						fastRotateOption("fastRotate", "Preprocessing: estimate auto-rotation angle from downsampled image moments instead of fitting ellipses, faster"),
+						rotateClassifierOption("rotateClassifier", "Preprocessing: apply auto-rotation to the lines angles instead of rotating the image"),
+						fusedOption("fused", "Preprocessing: detect cell edges and lines in a single pass"),
+						containerOption("container", "Write all outputs of an image into one multi-page tiff, compressed with none, fast or lzw", "compression"),
+						segmentsOption("segments", "Write the accepted lines of every image as a list of segments, csv or bin (images up to 65535 px)", "format"),
+						storeCandidatesOption("storeCandidates", "Store every candidate line with its coverage, so the lines can be reclassified without detecting them again (images up to 65535 px)"),
+						reclassifyOption("reclassify", "Reclassify the candidates stores given instead of images with the current angles and coverage, write the masks and the BioLines2_reclassified report and quit"),
+						renderOption("render", "Render the selected outputs from the containers given instead of images and quit"),
+						watchOption("watch", "Process the images written into the directory as soon as they are complete, until stopped", "directory"),
+						serveOption("serve", "Serve jobs sent as JSON lines to the local socket of this name, with the other options as the default parameters", "name");
 
 	// setup all options
 	parser.setApplicationDescription("BioLines");
@@ -143,12 +183,32 @@ void BioLines2::setArgs(const QStringList& args) {
 	parser.addOption(autoStartOption);
 	parser.addOption(autoCloseOption);
 	parser.addOption(noSaveOption);
+	parser.addOption(resumeOption);
+	parser.addOption(threadsOption);
+	parser.addOption(pinOption);
+	parser.addOption(lowPriorityOption);
+	parser.addOption(statusOption);
+	parser.addOption(timeBudgetOption);
+	parser.addOption(toleranceOption);
+	parser.addOption(densityOption);
+	parser.addOption(boxThresholdOption);
+	parser.addOption(fastRotateOption);
+	parser.addOption(rotateClassifierOption);
+	parser.addOption(fusedOption);
+	parser.addOption(containerOption);
+	parser.addOption(segmentsOption);
+	parser.addOption(storeCandidatesOption);
+	parser.addOption(reclassifyOption);
+	parser.addOption(renderOption);
+	parser.addOption(watchOption);
+	parser.addOption(serveOption);
 
 	// parse & set values
 	if (parser.parse(args)) {
 
 		selectedImages = parser.positionalArguments();
 		ui.selectedImagesLabel->setText(QString("%1 images selected").arg(selectedImages.size()));
+		updatePreviewImages();
 
 		if (parser.isSet(outputDirOption)) {
 			outputDir = parser.value(outputDirOption);
@@ -203,10 +263,106 @@ void BioLines2::setArgs(const QStringList& args) {
 
 		saveSettingsOnQuit = !parser.isSet(noSaveOption);
 		closeOnFinish = parser.isSet(autoCloseOption);
+		resume = parser.isSet(resumeOption);
+		if (parser.isSet(threadsOption))
+			threads = parser.value(threadsOption).toInt();
+		pinThreads = parser.isSet(pinOption);
+		lowPriority = parser.isSet(lowPriorityOption);
+		printStatus = parser.isSet(statusOption);
+		if (parser.isSet(timeBudgetOption))
+			timeBudgetMs = parser.value(timeBudgetOption).toInt();
+		if (parser.isSet(toleranceOption))
+			tolerance = parser.value(toleranceOption).toFloat();
+		if (parser.isSet(densityOption))
+			samplingDensity = parser.value(densityOption).toFloat();
+		thresholdBackend = parser.isSet(boxThresholdOption) ? Preprocessor::BoxThreshold : Preprocessor::GaussianThreshold;
+		orientationMethod = parser.isSet(fastRotateOption) ? Preprocessor::Moments : Preprocessor::EllipseFit;
+		rotateClassifier = parser.isSet(rotateClassifierOption);
+		fusedDetection = parser.isSet(fusedOption);
+		if (parser.isSet(containerOption)) {
+			QString compression = parser.value(containerOption).toLower();
+			if (compression == "lzw")
+				container = TiffWriter::Lzw;
+			else if (compression == "fast")
+				container = TiffWriter::PackBits;
+			else if (compression == "none")
+				container = TiffWriter::NoCompression;
+			else {
+				printf("Unknown container compression %s, use none, fast or lzw\n", compression.toLocal8Bit().constData());
+				parser.showHelp(1);
+			}
+		}
+		if (parser.isSet(segmentsOption)) {
+			QString format = parser.value(segmentsOption).toLower();
+			if (format == "csv")
+				segments = SegmentFile::Csv;
+			else if (format == "bin")
+				segments = SegmentFile::Binary;
+			else {
+				printf("Unknown segments format %s, use csv or bin\n", format.toLocal8Bit().constData());
+				parser.showHelp(1);
+			}
+		}
+		storeCandidates = parser.isSet(storeCandidatesOption);
+
+		// masks and report from the stored candidates of a previous run
+		if (parser.isSet(reclassifyOption)) {
+			AlgorithmWorker::Parameters params = parameters();
+			if (params.out_dir.isEmpty() && !selectedImages.isEmpty())
+				params.out_dir = QFileInfo(selectedImages.first()).absolutePath();
+			// own report next to the one of the batch, its journal is kept, reclassifying again only replaces the rows
+			Report report(params.out_dir, params.class1_name, params.class2_name, params.class3_name, params.hash(), true, "BioLines2_reclassified");
+			for (QStringList::ConstIterator it = selectedImages.begin(); it != selectedImages.end(); ++it)
+				if (!AlgorithmWorker::reclassify(*it, params, report))
+					printf("%s: can't reclassify all the lines\n", it->toLocal8Bit().constData());
+			report.saveToDisk();
+			saveSettingsOnQuit = false;
+			QTimer::singleShot(0, this, &QWidget::close);
+			return;
+		}
+
+		// colored images from containers of a previous run, the window is closed once the event loop starts
+		if (parser.isSet(renderOption)) {
+			AlgorithmWorker::Parameters params = parameters();
+			for (QStringList::ConstIterator it = selectedImages.begin(); it != selectedImages.end(); ++it)
+				if (!AlgorithmWorker::render(*it, params))
+					printf("%s: can't render all the outputs\n", it->toLocal8Bit().constData());
+			saveSettingsOnQuit = false;
+			QTimer::singleShot(0, this, &QWidget::close);
+			return;
+		}
+
+		// local job server, runs until the window is closed
+		if (parser.isSet(serveOption)) {
+			JobServer* server = new JobServer(parameters(), this);
+			QString name = parser.value(serveOption);
+			if (server->listen(name))
+				ui.etaLabel->setText(QString("Serving jobs on %1").arg(name));
+			else {
+				printf("Can't listen on %s: %s\n", name.toLocal8Bit().constData(), server->errorString().toLocal8Bit().constData());
+				delete server;
+			}
+			return;
+		}
+
+		// hot folder, the output goes next to the images unless set, started right away
+		if (parser.isSet(watchOption)) {
+			watchDir = parser.value(watchOption);
+			if (!parser.isSet(outputDirOption)) {
+				outputDir = watchDir;
+				ui.outputDirLabel->setText(outputDir);
+			}
+			ui.selectedImagesLabel->setText(QString("Watching %1").arg(watchDir));
+			startStopAlgorithm();
+			return;
+		}
 
 		// start algorithm if autostart enabled
 		if (parser.isSet(autoStartOption))
 			startStopAlgorithm();
+		// the window stays open for the user
+		if (!closeOnFinish)
+			startPreview();
 	}
 	else
 		parser.showHelp();
@@ -216,6 +372,7 @@ void BioLines2::selectImages() {
 	if (inputDialog.exec()) {
 		selectedImages = inputDialog.selectedFiles();
 		ui.selectedImagesLabel->setText(QString("%1 images selected").arg(selectedImages.size()));
+		updatePreviewImages();
 		setOutDirSameAsInput(); // if checkbox checked
 	}
 }
@@ -242,8 +399,69 @@ void BioLines2::adjust2ndangle() {
 	ui.colorTreshold2SpinBox->setValue(std::max(angle1, angle2));
 }
 
+AlgorithmWorker::Parameters BioLines2::parameters() const {
+	LinesParameters cellWalls = {
+		cv::Vec3b(0xFF, 0, 0),
+		cv::Vec3b(0, 0xFF, 0),
+		cv::Vec3b(0, 0, 0xFF),
+		ui.cellWallsLineLengthSpinBox->value(),
+		ui.cellWallsLineThicknessSpinBox->value(),
+		ui.iterationsSpinBox->value(),
+		ui.colorTreshold1SpinBox->value(),
+		ui.colorTreshold2SpinBox->value(),
+		ui.cellWallsCoverageSpinBox->value() / 100.0f,
+		0,
+		samplingDensity
+	};
+	LinesParameters mainAlgo = {
+		ui.class1ColorButton->getOpenCvColor(),
+		ui.class2ColorButton->getOpenCvColor(),
+		ui.class3ColorButton->getOpenCvColor(),
+		ui.lineLengthSpinBox->value(),
+		ui.lineThicknessSpinBox->value(),
+		ui.iterationsSpinBox->value(),
+		ui.colorTreshold1SpinBox->value(),
+		ui.colorTreshold2SpinBox->value(),
+		ui.coverageSpinBox->value() / 100.0f,
+		tolerance,
+		samplingDensity
+	};
+	AlgorithmWorker::Parameters params = {
+		outputDir,
+		cellWalls,
+		mainAlgo,
+		ui.autoRotateCheckBox->isChecked(),
+		ui.removeCellEdgesCheckBox->isChecked(),
+		ui.removedCellEdgesPreviewCheckBox->isChecked(),
+		ui.allClassesCheckBox->isChecked(),
+		ui.allClassesWithSrcCheckbox->isChecked(),
+		ui.class1CheckBox->isChecked(),
+		ui.class1withSrcCheckbox->isChecked(),
+		ui.class2CheckBox->isChecked(),
+		ui.class2withSrcCheckbox->isChecked(),
+		ui.class3CheckBox->isChecked(),
+		ui.class3withSrcCheckbox->isChecked(),
+		ui.class1NameEdit->text(),
+		ui.class2NameEdit->text(),
+		ui.class3NameEdit->text(),
+		resume,
+		threads,
+		pinThreads,
+		lowPriority,
+		timeBudgetMs,
+		thresholdBackend,
+		orientationMethod,
+		rotateClassifier,
+		fusedDetection,
+		container,
+		segments,
+		storeCandidates
+	};
+	return params;
+}
+
 void BioLines2::startStopAlgorithm() {
-	if (selectedImages.size() > 0 && outputDir != "") {
+	if ((selectedImages.size() > 0 || !watchDir.isEmpty()) && outputDir != "") {
 		if (algo.isRunning()) {
 			algo.stop();
 			ui.progressBar->setValue(0);
@@ -251,48 +469,12 @@ void BioLines2::startStopAlgorithm() {
 			ui.runButton->setText("Stopping ...");
 		}
 		else {
-			AlgorithmWorker::LinesParameters cellWalls = {
-				cv::Vec3b(0xFF, 0, 0),
-				cv::Vec3b(0, 0xFF, 0),
-				cv::Vec3b(0, 0, 0xFF),
-				ui.cellWallsLineLengthSpinBox->value(),
-				ui.cellWallsLineThicknessSpinBox->value(),
-				ui.iterationsSpinBox->value(),
-				ui.colorTreshold1SpinBox->value(),
-				ui.colorTreshold2SpinBox->value(),
-				ui.cellWallsCoverageSpinBox->value() / 100.0f
-			};
-			AlgorithmWorker::LinesParameters mainAlgo = {
-				ui.class1ColorButton->getOpenCvColor(),
-				ui.class2ColorButton->getOpenCvColor(),
-				ui.class3ColorButton->getOpenCvColor(),
-				ui.lineLengthSpinBox->value(),
-				ui.lineThicknessSpinBox->value(),
-				ui.iterationsSpinBox->value(),
-				ui.colorTreshold1SpinBox->value(),
-				ui.colorTreshold2SpinBox->value(),
-				ui.coverageSpinBox->value() / 100.0f
-			};
-			AlgorithmWorker::Parameters params = {
-				outputDir,
-				cellWalls,
-				mainAlgo,
-				ui.autoRotateCheckBox->isChecked(),
-				ui.removeCellEdgesCheckBox->isChecked(),
-				ui.removedCellEdgesPreviewCheckBox->isChecked(),
-				ui.allClassesCheckBox->isChecked(),
-				ui.allClassesWithSrcCheckbox->isChecked(),
-				ui.class1CheckBox->isChecked(),
-				ui.class1withSrcCheckbox->isChecked(),
-				ui.class2CheckBox->isChecked(),
-				ui.class2withSrcCheckbox->isChecked(),
-				ui.class3CheckBox->isChecked(),
-				ui.class3withSrcCheckbox->isChecked(),
-				ui.class1NameEdit->text(),
-				ui.class2NameEdit->text(),
-				ui.class3NameEdit->text()
-			};
-			algo.start(selectedImages, params);
+			if (watchDir.isEmpty())
+				algo.start(selectedImages, parameters());
+			else
+				algo.start(watchDir, parameters());
+			// --resume applies only to the run started from the command line
+			resume = false;
 			ui.runButton->setText("Stop");
 		}
 	}
@@ -307,6 +489,41 @@ void BioLines2::onAlgoFinished() {
 		close();
 }
 
+void BioLines2::printStatusLine(const QString& status) {
+	if (!printStatus) return;
+	printf("%s\n", status.toLocal8Bit().constData());
+	fflush(stdout);
+}
+
+void BioLines2::updatePreviewImages() {
+	// the preview is restarted once, after the list is filled
+	ui.previewImageComboBox->blockSignals(true);
+	ui.previewImageComboBox->clear();
+	for (QStringList::ConstIterator it = selectedImages.begin(); it != selectedImages.end(); ++it)
+		ui.previewImageComboBox->addItem(QFileInfo(*it).fileName(), *it);
+	ui.previewImageComboBox->blockSignals(false);
+	if (!previewStarted) return;
+	thumbnails.setFiles(selectedImages);
+	updatePreview();
+}
+
+void BioLines2::startPreview() {
+	previewStarted = true;
+	updatePreviewImages();
+}
+
+void BioLines2::updatePreview() {
+	if (!previewStarted) return;
+	QString image = ui.previewImageComboBox->currentData().toString();
+	if (image.isEmpty()) return;
+	previewDetector.request(image, parameters().mainAlgo, thresholdBackend);
+}
+
+void BioLines2::showPreview(const QImage& overlay, const QString& status) {
+	ui.livePreviewLabel->setPixmap(QPixmap::fromImage(overlay));
+	ui.livePreviewStatusLabel->setText(status);
+}
+
 void BioLines2::readSettings() {
 	QSettings settings(QSettings::IniFormat, QSettings::UserScope, "BioLines2");
 
@@ -348,6 +565,7 @@ void BioLines2::readSettings() {
 	ui.class2NameEdit->setText(settings.value("class2_name", "Oblique").toString());
 	ui.class3NameEdit->setText(settings.value("class3_name", "Longitudinal").toString());
 	settings.endGroup();
+	updatePreviewImages();
 }
 
 void BioLines2::writeSettings() {
@@ -23,6 +23,8 @@
 #include <QtWidgets/QMainWindow>
 #include "ui_biolines2.h"
 #include "algorithm.h"
+#include "previewdetector.h"
+#include "thumbnailmodel.h"
 
 class BioLines2 : public QMainWindow
 {
@@ -32,9 +34,29 @@ private:
 	QFileDialog inputDialog, outputDialog;
 	QStringList selectedImages;
 	QString outputDir;
+	// hot folder from the command line, processed instead of the selected images
+	QString watchDir;
 	Algorithm algo;
+	PreviewDetector previewDetector;
+	ThumbnailModel thumbnails;
 	bool saveSettingsOnQuit;
 	bool closeOnFinish;
+	bool resume;
+	int threads;
+	bool pinThreads, lowPriority;
+	int timeBudgetMs;
+	float tolerance;
+	float samplingDensity;
+	int thresholdBackend;
+	int orientationMethod;
+	bool rotateClassifier;
+	bool fusedDetection;
+	int container;
+	int segments;
+	bool storeCandidates;
+	bool printStatus;
+	// live preview and thumbnails, only for the interactive window
+	bool previewStarted;
 
 public:
 	BioLines2(QWidget *parent = 0);
@@ -42,6 +64,8 @@ public:
 
 	// in case of running the program from commandline with parameters specified
 	void setArgs(const QStringList& args);
+	// starts the live preview and the thumbnails of the selected images, the window is used interactively
+	void startPreview();
 
 protected slots:
 	// opens images selection dialog
@@ -56,12 +80,23 @@ protected slots:
 	void startStopAlgorithm();
 	// when algo finishes set button to Run again
 	void onAlgoFinished();
+	// prints the periodic status line to the console
+	void printStatusLine(const QString& status);
+	// restarts the live preview with the current parameters
+	void updatePreview();
+	// shows the overlay published by the preview detector
+	void showPreview(const QImage& overlay, const QString& status);
 
 protected:
 	// on close e need to stop the algorithm and wait for it's thread to finish and also save changed fields values
 	void closeEvent(QCloseEvent *event) override;
 
 private:
+	// algorithm parameters from the ui and the command line
+	AlgorithmWorker::Parameters parameters() const;
+	// fills the preview image list and, once started, the thumbnails with the selected images
+	void updatePreviewImages();
+
 	void readSettings();
 	void writeSettings();
 
@@ -0,0 +1,122 @@
+/*
+* BioLines (https://github.com/mmuszkow/BioLines)
+* Detection of filamentous structures in biological microscopic images
+* Copyright(C) 2017 Maciek Muszkowski
+*
+* This program is free software : you can redistribute it and / or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "stdafx.h"
+#include "candidatestore.h"
+
+CandidateStore::CandidateStore() {
+	memset(&_header, 0, sizeof(_header));
+	memcpy(_header.magic, "BLCD", 4);
+	_header.version = VERSION;
+}
+
+void CandidateStore::begin(int width, int height, const LinesParameters& params, float angleOffset, float coverageFloor) {
+	_header.width = width;
+	_header.height = height;
+	_header.lineLength = static_cast<uint16_t>(params.line_length);
+	_header.lineThickness = static_cast<uint16_t>(params.line_thickness);
+	_header.angleOffset = angleOffset;
+	_header.coverageFloor = coverageFloor;
+	_candidates.clear();
+}
+
+void CandidateStore::finish(const DetectionStats& stats) {
+	_header.candidates = stats.candidates;
+	_header.foreground = stats.foreground;
+	_header.budget = stats.budget;
+	_header.stopReason = static_cast<uint8_t>(stats.stopReason);
+}
+
+bool CandidateStore::write(const std::string& fn) {
+	if (!fits()) return false;
+	FILE* f;
+	fopen_s(&f, fn.c_str(), "wb");
+	if (!f) return false;
+	_header.count = static_cast<uint32_t>(_candidates.size());
+	_header.pathLength = static_cast<uint16_t>(_sourcePath.size());
+	fwrite(&_header, sizeof(_header), 1, f);
+	fwrite(_sourcePath.data(), 1, _sourcePath.size(), f);
+	if (!_candidates.empty())
+		fwrite(_candidates.data(), sizeof(Candidate), _candidates.size(), f);
+	bool ok = ferror(f) == 0;
+	return fclose(f) == 0 && ok;
+}
+
+bool CandidateStore::read(const std::string& fn) {
+	FILE* f;
+	fopen_s(&f, fn.c_str(), "rb");
+	if (!f) return false;
+
+	Header header;
+	if (fread(&header, sizeof(header), 1, f) != 1 || memcmp(header.magic, "BLCD", 4) != 0 || header.version != VERSION) {
+		fclose(f);
+		return false;
+	}
+	std::string path(header.pathLength, '\0');
+	std::vector<Candidate> candidates(header.count);
+	bool ok = (path.empty() || fread(&path[0], 1, path.size(), f) == path.size())
+		&& (candidates.empty() || fread(candidates.data(), sizeof(Candidate), candidates.size(), f) == candidates.size());
+	fclose(f);
+	if (!ok) return false;
+
+	_header = header;
+	_sourcePath = path;
+	_candidates.swap(candidates);
+	return true;
+}
+
+LinesOutput CandidateStore::replay(const LinesParameters& params) const {
+	LinesOutput output(cv::Mat::zeros(_header.height, _header.width, CV_8UC1));
+	output.stats.candidates = _header.candidates;
+	output.stats.foreground = _header.foreground;
+	output.stats.budget = _header.budget;
+	output.stats.stopReason = static_cast<DetectionStats::StopReason>(_header.stopReason);
+
+	// same as the detection loop, only the candidates not stored are rejected without looking at them
+	ConvergenceMonitor convergence;
+	uint32_t replayed = 0;
+	for (std::vector<Candidate>::const_iterator it = _candidates.begin(); it != _candidates.end(); ++it) {
+		for (; replayed < it->iteration; replayed++)
+			convergence.add(-1);
+		replayed++;
+
+		int cls = -1;
+		if (it->coverage > params.min_coverage) {
+			float classAngle = offsetAngle(it->angle, _header.angleOffset);
+			cls = params.classify(classAngle);
+
+			output.stats.accepted++;
+			output.stats.angles[static_cast<int>(classAngle) % 360]++;
+			output.stats.coverageSum += it->coverage;
+
+			// end point exactly as in the detection loop
+			int x2 = it->x1 + _header.lineLength * cos(LineDetector::deg2rad(it->angle));
+			int y2 = it->y1 + _header.lineLength * sin(LineDetector::deg2rad(it->angle));
+			const cv::Vec3b& color = params.color(cls);
+			output.classImg(cls).line(it->x1, it->y1, x2, y2, _header.lineThickness, color);
+			output.all.line(it->x1, it->y1, x2, y2, _header.lineThickness, color);
+		}
+		convergence.add(cls);
+	}
+	for (; replayed < _header.candidates; replayed++)
+		convergence.add(-1);
+	output.stats.precision = static_cast<float>(convergence.halfWidth() * 100);
+	return output;
+}
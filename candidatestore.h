@@ -0,0 +1,109 @@
+/*
+* BioLines (https://github.com/mmuszkow/BioLines)
+* Detection of filamentous structures in biological microscopic images
+* Copyright(C) 2017 Maciek Muszkowski
+*
+* This program is free software : you can redistribute it and / or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include "linedetector.h"
+
+// Every candidate line of the main detection pass with its coverage, enough to classify them again with different
+// angle ranges or coverage threshold and draw the accepted ones without running the detection. Coverage is measured
+// on the binarized image only, so it doesn't depend on which lines were accepted before and the replay gives the same
+// lines as the detection would. Candidates without any foreground under them are not stored, they can never pass.
+//
+// binary, little-endian: header, absolute path of the source image, then 14 bytes per candidate:
+//   uint32 iteration, uint16 x1, y1, angle in degrees (before the auto-rotation offset), float coverage
+// images wider or taller than 65535 px are not written
+class CandidateStore {
+#pragma pack(push, 1)
+	struct Header {
+		char magic[4];
+		uint16_t version;
+		uint16_t lineLength, lineThickness;
+		uint16_t pathLength;
+		uint32_t width, height;
+		// auto-rotation offset subtracted from the angles before classifying them
+		float angleOffset;
+		// candidates with coverage up to this were not stored, 0 except for the fused detection
+		float coverageFloor;
+		// detection pass statistics which don't depend on the classification
+		uint32_t candidates, foreground;
+		int32_t budget;
+		uint8_t stopReason, reserved[3];
+		uint32_t count;
+	};
+	struct Candidate {
+		uint32_t iteration;
+		uint16_t x1, y1, angle;
+		float coverage;
+	};
+#pragma pack(pop)
+
+	Header _header;
+	std::string _sourcePath;
+	std::vector<Candidate> _candidates;
+
+public:
+	static const uint16_t VERSION = 2;
+	// coordinates are 16-bit
+	static const uint32_t MAX_SIZE = 65535;
+
+	CandidateStore();
+
+	// starts a new detection pass
+	void begin(int width, int height, const LinesParameters& params, float angleOffset, float coverageFloor = 0);
+
+	inline void add(int iteration, int x1, int y1, int angle, float coverage) {
+		if (coverage <= _header.coverageFloor) return;
+		Candidate candidate = { static_cast<uint32_t>(iteration), static_cast<uint16_t>(x1), static_cast<uint16_t>(y1), static_cast<uint16_t>(angle), coverage };
+		_candidates.push_back(candidate);
+	}
+
+	// statistics of the finished pass
+	void finish(const DetectionStats& stats);
+
+	// absolute, the store is written into the output directory which may not be the one of the image
+	inline void setSourcePath(const std::string& path) {
+		_sourcePath = path;
+	}
+
+	inline const std::string& sourcePath() const {
+		return _sourcePath;
+	}
+
+	// replay with a coverage threshold lower than this misses some lines
+	inline float coverageFloor() const {
+		return _header.coverageFloor;
+	}
+
+	// false if the image of the pass is too large for the format
+	inline bool fits() const {
+		return _header.width <= MAX_SIZE && _header.height <= MAX_SIZE;
+	}
+
+	// false if the file can't be written or the image doesn't fit, nothing is written then
+	bool write(const std::string& fn);
+	bool read(const std::string& fn);
+
+	// classifies the stored candidates with the angle ranges, coverage threshold and colors of the params and draws
+	// the accepted ones, line length and thickness are those of the detection
+	LinesOutput replay(const LinesParameters& params) const;
+};
@@ -0,0 +1,94 @@
+/*
+* BioLines (https://github.com/mmuszkow/BioLines)
+* Detection of filamentous structures in biological microscopic images
+* Copyright(C) 2017 Maciek Muszkowski
+*
+* This program is free software : you can redistribute it and / or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+
+// Confidence interval of the classes shares among the accepted lines, estimated by batch means over the candidate stream,
+// each batch gives the accepted lines count per class, the share is a ratio estimator and its variance comes
+// from the spread of the batches around it, cheap enough to run for every image
+class ConvergenceMonitor {
+public:
+	static const int CLASSES = 3;
+	// candidates per batch
+	static const int BATCH_SIZE = 4096;
+	// batches needed before the interval is trusted
+	static const int MIN_BATCHES = 30;
+
+private:
+	// current batch
+	int _inBatch, _batchAccepted, _batchClass[CLASSES];
+	// sums over closed batches, a - accepted of the class, n - accepted of all classes
+	int _batches;
+	double _sumA[CLASSES], _sumA2[CLASSES], _sumAN[CLASSES], _sumN, _sumN2;
+
+	inline void closeBatch() {
+		double n = _batchAccepted;
+		for (int c = 0; c < CLASSES; c++) {
+			double a = _batchClass[c];
+			_sumA[c] += a;
+			_sumA2[c] += a * a;
+			_sumAN[c] += a * n;
+			_batchClass[c] = 0;
+		}
+		_sumN += n;
+		_sumN2 += n * n;
+		_batches++;
+		_inBatch = _batchAccepted = 0;
+	}
+
+public:
+	ConvergenceMonitor() : _inBatch(0), _batchAccepted(0), _batches(0), _sumN(0), _sumN2(0) {
+		for (int c = 0; c < CLASSES; c++)
+			_batchClass[c] = 0, _sumA[c] = _sumA2[c] = _sumAN[c] = 0;
+	}
+
+	// adds single candidate, cls is the class of accepted line or -1 if rejected, returns true when a batch was closed
+	inline bool add(int cls) {
+		if (cls >= 0) {
+			_batchClass[cls]++;
+			_batchAccepted++;
+		}
+		if (++_inBatch < BATCH_SIZE) return false;
+		closeBatch();
+		return true;
+	}
+
+	inline int batches() const {
+		return _batches;
+	}
+
+	// 95% confidence interval half-width of the widest class share (0-1), negative if there is not enough batches yet
+	double halfWidth() const {
+		if (_batches < MIN_BATCHES || _sumN == 0) return -1;
+		double m = _batches;
+		double meanN = _sumN / m;
+		double widest = 0;
+		for (int c = 0; c < CLASSES; c++) {
+			// sum of (a - p*n)^2 over batches
+			double p = _sumA[c] / _sumN;
+			double ss = _sumA2[c] - 2 * p * _sumAN[c] + p * p * _sumN2;
+			double variance = std::max(0.0, ss) / (m * (m - 1) * meanN * meanN);
+			widest = std::max(widest, 1.96 * std::sqrt(variance));
+		}
+		return widest;
+	}
+};
@@ -0,0 +1,250 @@
+/*
+* BioLines (https://github.com/mmuszkow/BioLines)
+* Detection of filamentous structures in biological microscopic images
+* Copyright(C) 2017 Maciek Muszkowski
+*
+* This program is free software : you can redistribute it and / or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "stdafx.h"
+#include "fuseddetector.h"
+#include "candidatestore.h"
+#include <memory>
+
+FusedDetector::FusedDetector(const LinesParameters& walls, const LinesParameters& main, const std::atomic<bool>& stopFlag, ImageProgress* progress) :
+	_walls(walls), _main(main), _shouldStop(stopFlag), _progress(progress), _angleOffset(0), _hasDeadline(false), _collectSegments(false), _candidates(NULL) {
+	buildStencils(walls, _wallsStencils);
+	buildStencils(main, _mainStencils);
+}
+
+void FusedDetector::buildStencils(const LinesParameters& params, std::vector<LinableImg::Stencil>& stencils) {
+	// end point computed the same way as in the detection loop for a typical start point, float rounding may give
+	// a different end for some starts, those lines fall back to walking the line
+	const int origin = 1024;
+	stencils.reserve(360);
+	for (int angle = 0; angle < 360; angle++) {
+		int x2 = origin + params.line_length * cos(LineDetector::deg2rad(angle));
+		int y2 = origin + params.line_length * sin(LineDetector::deg2rad(angle));
+		stencils.push_back(LinableImg::Stencil(x2 - origin, y2 - origin, params.line_thickness));
+	}
+}
+
+static inline bool validLine(int x1, int y1, int x2, int y2, int cols, int rows) {
+	return !(x1 == x2
+		|| x1 < 0 || y1 < 0 || x2 < 0 || y2 < 0
+		|| x1 >= cols || y1 >= rows || x2 >= cols || y2 >= rows);
+}
+
+// angle for the start point, redrawn until the line fits in the image, as in LineDetector
+static inline int sampleAngle(const LinesParameters& params, int x1, int y1, int cols, int rows, int& x2, int& y2) {
+	int angle;
+	do {
+		angle = rand() % 360;
+		x2 = x1 + params.line_length * cos(LineDetector::deg2rad(angle));
+		y2 = y1 + params.line_length * sin(LineDetector::deg2rad(angle));
+	} while (!validLine(x1, y1, x2, y2, cols, rows));
+	return angle;
+}
+
+bool FusedDetector::decide(LinesOutput& output, ConvergenceMonitor& convergence, int iteration, const Candidate* candidate) {
+	output.stats.candidates = iteration + 1;
+	int cls = -1;
+	if (candidate) {
+		const LinableImg::Stencil& stencil = _mainStencils[candidate->angle];
+		float coverage = FusedDetector::coverage(output.bin, stencil, candidate->x1, candidate->y1, candidate->x2, candidate->y2, _main.line_thickness);
+		if (_candidates)
+			_candidates->add(iteration, candidate->x1, candidate->y1, candidate->angle, coverage);
+		if (coverage > _main.min_coverage) {
+			float classAngle = offsetAngle(candidate->angle, _angleOffset);
+			cls = _main.classify(classAngle);
+
+			output.stats.accepted++;
+			output.stats.angles[static_cast<int>(classAngle) % 360]++;
+			output.stats.coverageSum += coverage;
+
+			const cv::Vec3b& color = _main.color(cls);
+			line(output.classImg(cls), stencil, candidate->x1, candidate->y1, candidate->x2, candidate->y2, _main.line_thickness, color);
+			line(output.all, stencil, candidate->x1, candidate->y1, candidate->x2, candidate->y2, _main.line_thickness, color);
+			if (_collectSegments) {
+				Segment segment = { candidate->x1, candidate->y1, candidate->x2, candidate->y2, classAngle, cls, coverage };
+				output.segments.push_back(segment);
+			}
+		}
+	}
+
+	// classes shares precise enough
+	if (convergence.add(cls) && _main.tolerance > 0) {
+		double halfWidth = convergence.halfWidth();
+		if (halfWidth >= 0 && halfWidth * 100 <= _main.tolerance) {
+			output.stats.stopReason = DetectionStats::Converged;
+			return true;
+		}
+	}
+	if (iteration % LineDetector::CUTOFF_CHECK_INTERVAL == 0 && LineDetector::cutoff(output.all, _main, static_cast<float>(output.stats.foreground))) {
+		output.stats.stopReason = DetectionStats::Cutoff;
+		return true;
+	}
+	return false;
+}
+
+bool FusedDetector::replay(LinesOutput& output, ConvergenceMonitor& convergence, const std::vector<Candidate>& pending, int& decided, int until) {
+	for (std::vector<Candidate>::const_iterator it = pending.begin(); it != pending.end(); ++it) {
+		// the candidates in between were rejected already
+		for (; decided < it->iteration; decided++)
+			if (decide(output, convergence, decided, NULL))
+				return true;
+		if (decide(output, convergence, decided++, &*it))
+			return true;
+	}
+	for (; decided < until; decided++)
+		if (decide(output, convergence, decided, NULL))
+			return true;
+	return false;
+}
+
+LinesOutput FusedDetector::detect(Preprocessor& pre) {
+	// only the bin is needed for the cell walls, edges go straight into the mask
+	LinableImg bin(pre.bin());
+	cv::Mat& edgeMask = pre.edgeMask();
+	int foreground = bin.count(WHITE);
+	int wallsIterations = LineDetector::budget(_walls, foreground, _hasDeadline);
+	// foreground of the masked bin is not known yet, the unmasked one is used for the auto-scaled iterations
+	int mainIterations = LineDetector::budget(_main, foreground, _hasDeadline);
+	if (_progress && wallsIterations != INT_MAX)
+		_progress->budget.fetch_add(static_cast<long long>(wallsIterations) + mainIterations, std::memory_order_relaxed);
+
+	const int cols = bin.cols, rows = bin.rows;
+	// cell walls lines of all the classes, for the cutoff only
+	LinableImg wallsAll(bin.size);
+	ConvergenceMonitor wallsConvergence, convergence;
+	// main candidates which passed on the unmasked bin, waiting for the cell walls mask
+	std::vector<Candidate> pending;
+	// main output, once the mask is complete
+	std::unique_ptr<LinesOutput> output;
+	DetectionStats::StopReason stopReason = DetectionStats::IterationsDone;
+	long long evaluated = 0, accepted = 0, published = 0, publishedAccepted = 0;
+	int walls = 0, main = 0, decided = 0;
+	bool wallsDone = wallsIterations == 0, mainDone = mainIterations == 0, mainStopped = false;
+	LineDetector::Clock::time_point wallsDeadline;
+	if (_hasDeadline) {
+		LineDetector::Clock::time_point now = LineDetector::Clock::now();
+		wallsDeadline = _deadline > now ? now + (_deadline - now) / 2 : _deadline;
+	}
+	for (int step = 0; ; step++) {
+		// mask is complete, the waiting main candidates are decided and the next ones right away
+		if (wallsDone && !output) {
+			output.reset(new LinesOutput(pre.binWithoutEdges()));
+			output->stats.foreground = output->bin.count(WHITE);
+			if (_candidates)
+				_candidates->begin(cols, rows, _main, _angleOffset, _main.min_coverage);
+			mainStopped = replay(*output, convergence, pending, decided, main);
+			mainDone = mainDone || mainStopped;
+			std::vector<Candidate>().swap(pending);
+		}
+		// too many waiting candidates, the cell walls are finished first
+		bool doMain = !mainDone && (output || pending.size() < MAX_PENDING);
+		if (wallsDone && !doMain) break;
+
+		if (_shouldStop.load(std::memory_order_relaxed)) {
+			LinesOutput cancelled(pre.bin());
+			cancelled.stats.stopReason = DetectionStats::Cancelled;
+			return cancelled;
+		}
+		if (_hasDeadline && (step & (LineDetector::DEADLINE_CHECK_INTERVAL - 1)) == 0 && step > 0) {
+			LineDetector::Clock::time_point now = LineDetector::Clock::now();
+			if (now >= _deadline) {
+				stopReason = DetectionStats::Deadline;
+				break;
+			}
+			// cell walls get the first half of the time, as when run separately
+			if (now >= wallsDeadline)
+				wallsDone = true;
+		}
+
+		// shared start point
+		int x1 = rand() % cols;
+		int y1 = rand() % rows;
+
+		// cell walls, only 1st and 3rd class are used for the mask
+		if (!wallsDone) {
+			int x2, y2;
+			int angle = sampleAngle(_walls, x1, y1, cols, rows, x2, y2);
+			const LinableImg::Stencil& stencil = _wallsStencils[angle];
+			evaluated++;
+			int cls = -1;
+			if (coverage(bin, stencil, x1, y1, x2, y2, _walls.line_thickness) > _walls.min_coverage) {
+				accepted++;
+				cls = _walls.classify(offsetAngle(angle, _angleOffset));
+				line(wallsAll, stencil, x1, y1, x2, y2, _walls.line_thickness, _walls.color(cls));
+				if (cls != 1)
+					edgeLine(edgeMask, stencil, x1, y1, x2, y2, _walls.line_thickness);
+			}
+			// same stops as LineDetector
+			bool converged = false;
+			if (wallsConvergence.add(cls) && _walls.tolerance > 0) {
+				double halfWidth = wallsConvergence.halfWidth();
+				converged = halfWidth >= 0 && halfWidth * 100 <= _walls.tolerance;
+			}
+			wallsDone = converged
+				|| (walls % LineDetector::CUTOFF_CHECK_INTERVAL == 0 && LineDetector::cutoff(wallsAll, _walls, static_cast<float>(foreground)))
+				|| ++walls >= wallsIterations;
+		}
+
+		// main, decided on the masked bin
+		if (doMain) {
+			Candidate candidate;
+			candidate.iteration = main;
+			candidate.x1 = x1;
+			candidate.y1 = y1;
+			candidate.angle = sampleAngle(_main, x1, y1, cols, rows, candidate.x2, candidate.y2);
+			evaluated++;
+			if (output) {
+				mainStopped = decide(*output, convergence, main, &candidate);
+				decided = main + 1;
+			}
+			else if (coverage(bin, _mainStencils[candidate.angle], x1, y1, candidate.x2, candidate.y2, _main.line_thickness) > _main.min_coverage)
+				pending.push_back(candidate);
+			mainDone = mainStopped || ++main >= mainIterations;
+		}
+
+		// live progress, main candidates are counted when they are decided
+		if (_progress && evaluated - published >= LineDetector::PUBLISH_INTERVAL) {
+			_progress->iterations.fetch_add(evaluated - published, std::memory_order_relaxed);
+			_progress->accepted.fetch_add(accepted - publishedAccepted, std::memory_order_relaxed);
+			published = evaluated;
+			publishedAccepted = accepted;
+		}
+	}
+
+	// deadline before the mask was complete, the candidates so far are decided on what was masked
+	if (!output) {
+		output.reset(new LinesOutput(pre.binWithoutEdges()));
+		output->stats.foreground = output->bin.count(WHITE);
+		if (_candidates)
+			_candidates->begin(cols, rows, _main, _angleOffset, _main.min_coverage);
+		mainStopped = replay(*output, convergence, pending, decided, main);
+	}
+	output->stats.budget = mainIterations == INT_MAX ? -1 : mainIterations;
+	if (!mainStopped)
+		output->stats.stopReason = stopReason;
+	output->stats.precision = static_cast<float>(convergence.halfWidth() * 100);
+	if (_candidates)
+		_candidates->finish(output->stats);
+
+	if (_progress) {
+		_progress->iterations.fetch_add(evaluated - published, std::memory_order_relaxed);
+		_progress->accepted.fetch_add(accepted - publishedAccepted + output->stats.accepted, std::memory_order_relaxed);
+	}
+	return std::move(*output);
+}
@@ -0,0 +1,110 @@
+/*
+* BioLines (https://github.com/mmuszkow/BioLines)
+* Detection of filamentous structures in biological microscopic images
+* Copyright(C) 2017 Maciek Muszkowski
+*
+* This program is free software : you can redistribute it and / or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <vector>
+#include "linedetector.h"
+#include "preprocessor.h"
+
+// Cell walls removal and main algorithm in a single pass, both parameter sets are evaluated from the same sampled
+// start points, using line stencils precomputed per angle instead of walking the lines every time. The angles are
+// sampled for each pass on its own, so both see the same lines distribution as when run separately.
+// Masking the cell walls only removes white pixels, so the main candidates which pass on the unmasked bin are a superset
+// of those which pass on the masked one. They wait until the cell walls mask is complete and are decided then, which
+// gives the same result as running the main algorithm on the masked bin with the same candidates. Later candidates
+// are decided right away, and when too many are waiting the cell walls are finished first.
+class FusedDetector {
+	const LinesParameters& _walls;
+	const LinesParameters& _main;
+	const std::atomic<bool>& _shouldStop;
+	// live counters, may be NULL
+	ImageProgress* _progress;
+	float _angleOffset;
+	bool _hasDeadline;
+	LineDetector::Clock::time_point _deadline;
+	bool _collectSegments;
+	CandidateStore* _candidates;
+
+	// stencils for every integer angle
+	std::vector<LinableImg::Stencil> _wallsStencils, _mainStencils;
+
+	// main candidate which passed on the unmasked bin
+	struct Candidate {
+		int iteration;
+		int x1, y1, x2, y2, angle;
+	};
+
+	// main candidates waiting for the cell walls mask, at most
+	static const size_t MAX_PENDING = 1 << 18;
+
+	// coverage through the stencil if the line matches it, otherwise the usual way
+	static inline float coverage(LinableImg& img, const LinableImg::Stencil& stencil, int x1, int y1, int x2, int y2, int w) {
+		if (x2 - x1 == stencil.dx && y2 - y1 == stencil.dy)
+			return img.coverage(stencil, x1, y1);
+		return img.coverage(x1, y1, x2, y2, w);
+	}
+
+	static inline void line(LinableImg& img, const LinableImg::Stencil& stencil, int x1, int y1, int x2, int y2, int w, const cv::Vec3b& color) {
+		if (x2 - x1 == stencil.dx && y2 - y1 == stencil.dy)
+			img.line(stencil, x1, y1, color);
+		else
+			img.line(x1, y1, x2, y2, w, color);
+	}
+
+	static inline void edgeLine(cv::Mat& mask, const LinableImg::Stencil& stencil, int x1, int y1, int x2, int y2, int w) {
+		if (x2 - x1 == stencil.dx && y2 - y1 == stencil.dy)
+			LinableImg::line(mask, stencil, x1, y1);
+		else
+			LinableImg::line(mask, x1, y1, x2, y2, w);
+	}
+
+	static void buildStencils(const LinesParameters& params, std::vector<LinableImg::Stencil>& stencils);
+
+	// main candidate on the masked bin, or one rejected already on the unmasked bin if NULL, stops the same way
+	// as LineDetector, true if the main detection should stop
+	bool decide(LinesOutput& output, ConvergenceMonitor& convergence, int iteration, const Candidate* candidate);
+	// decides the waiting candidates and the rejected iterations in between, until the iteration, true if it should stop
+	bool replay(LinesOutput& output, ConvergenceMonitor& convergence, const std::vector<Candidate>& pending, int& decided, int until);
+
+public:
+	FusedDetector(const LinesParameters& walls, const LinesParameters& main, const std::atomic<bool>& stopFlag, ImageProgress* progress = NULL);
+
+	// same as LineDetector
+	inline void setAngleOffset(float degrees) {
+		_angleOffset = degrees;
+	}
+
+	inline void setDeadline(const LineDetector::Clock::time_point& deadline) {
+		_deadline = deadline;
+		_hasDeadline = true;
+	}
+
+	inline void setCollectSegments(bool collect) {
+		_collectSegments = collect;
+	}
+
+	// only the main candidates which passed on the unmasked bin are known, so the store can't replay lower coverage thresholds
+	inline void setCandidateStore(CandidateStore* store) {
+		_candidates = store;
+	}
+
+	// detects the cell walls on pre.bin(), removes them (pre.binWithoutEdges) and returns main algorithm output for it
+	LinesOutput detect(Preprocessor& pre);
+};
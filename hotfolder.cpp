@@ -0,0 +1,61 @@
+/*
+* BioLines (https://github.com/mmuszkow/BioLines)
+* Detection of filamentous structures in biological microscopic images
+* Copyright(C) 2017 Maciek Muszkowski
+*
+* This program is free software : you can redistribute it and / or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "stdafx.h"
+#include "hotfolder.h"
+
+HotFolder::HotFolder(const QString& dir, QObject *parent) : QObject(parent), _dir(QDir(dir).absolutePath()) {
+	_watcher.addPath(_dir);
+	connect(&_watcher, &QFileSystemWatcher::directoryChanged, this, &HotFolder::scan);
+	connect(&_timer, &QTimer::timeout, this, &HotFolder::scan);
+	_timer.start(CHECK_INTERVAL_MS);
+	// first scan once the event loop runs, so the caller can connect first
+	QTimer::singleShot(0, this, &HotFolder::scan);
+}
+
+void HotFolder::scan() {
+	// same formats as the input images dialog
+	static const QStringList filters = QStringList() << "*.png" << "*.jpg" << "*.jpeg" << "*.tif" << "*.lsm";
+	QFileInfoList files = QDir(_dir).entryInfoList(filters, QDir::Files | QDir::Readable, QDir::Name);
+	for (QFileInfoList::ConstIterator it = files.begin(); it != files.end(); ++it) {
+		QString fn = it->absoluteFilePath();
+		if (_seen.contains(fn)) continue;
+
+		// complete when nothing changed since the last checks, notifications come more often than the timer
+		// so the checks are counted only on the timer ticks
+		QHash<QString, Pending>::Iterator pending = _pending.find(fn);
+		if (pending == _pending.end()) {
+			Pending p = { it->size(), it->lastModified(), 0 };
+			_pending.insert(fn, p);
+			continue;
+		}
+		if (pending->size != it->size() || pending->modified != it->lastModified() || it->size() == 0) {
+			pending->size = it->size();
+			pending->modified = it->lastModified();
+			pending->stableChecks = 0;
+			continue;
+		}
+		if (sender() == &_timer && ++pending->stableChecks >= STABLE_CHECKS) {
+			_pending.erase(pending);
+			_seen.insert(fn);
+			emit imageReady(fn);
+		}
+	}
+}
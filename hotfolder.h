@@ -0,0 +1,77 @@
+/*
+* BioLines (https://github.com/mmuszkow/BioLines)
+* Detection of filamentous structures in biological microscopic images
+* Copyright(C) 2017 Maciek Muszkowski
+*
+* This program is free software : you can redistribute it and / or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef HOTFOLDER_H
+#define HOTFOLDER_H
+
+#include <QObject>
+#include <QFileSystemWatcher>
+#include <QTimer>
+#include <QDateTime>
+#include <QHash>
+#include <QSet>
+
+// Watches a directory for new images, an image is reported once it's completely written, that is its size
+// and modification time didn't change for a few checks in a row, the directory is also rescanned periodically
+// because change notifications are not reliable on network shares
+class HotFolder : public QObject
+{
+	Q_OBJECT
+
+private:
+	// file seen, but maybe still being written
+	struct Pending {
+		qint64 size;
+		QDateTime modified;
+		int stableChecks;
+	};
+
+	QString _dir;
+	QFileSystemWatcher _watcher;
+	QTimer _timer;
+	QHash<QString, Pending> _pending;
+	// already reported or ignored
+	QSet<QString> _seen;
+
+	// how often the pending files are checked
+	static const int CHECK_INTERVAL_MS = 1000;
+	// unchanged checks in a row after which the file is complete
+	static const int STABLE_CHECKS = 2;
+
+private slots:
+	// looks for new images and checks the pending ones
+	void scan();
+
+public:
+	// images already in the directory are reported as well
+	HotFolder(const QString& dir, QObject *parent = 0);
+
+	// the file won't be reported, for outputs written into the watched directory
+	inline void ignore(const QString& fn) {
+		_seen.insert(fn);
+		_pending.remove(fn);
+	}
+
+signals:
+	// absolute path of the complete image
+	void imageReady(const QString& fn);
+};
+
+#endif // HOTFOLDER_H
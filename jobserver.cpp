@@ -0,0 +1,249 @@
+/*
+* BioLines (https://github.com/mmuszkow/BioLines)
+* Detection of filamentous structures in biological microscopic images
+* Copyright(C) 2017 Maciek Muszkowski
+*
+* This program is free software : you can redistribute it and / or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "stdafx.h"
+#include "jobserver.h"
+
+JobServer::JobServer(const AlgorithmWorker::Parameters& defaults, QObject *parent) : QObject(parent),
+	_defaults(defaults), _busy(false), _cancelled(false), _progress(0) {
+	connect(&_server, &QLocalServer::newConnection, this, &JobServer::onNewConnection);
+	connect(&_algo, &Algorithm::progressMade, this, &JobServer::onProgressMade);
+	connect(&_algo, &Algorithm::etaUpdated, this, &JobServer::onEtaUpdated);
+	connect(&_algo, &Algorithm::imageFinished, this, &JobServer::onImageFinished);
+	connect(&_algo, &Algorithm::finished, this, &JobServer::onAlgoFinished);
+}
+
+JobServer::~JobServer() {
+	_algo.stop();
+	_algo.wait();
+	_server.close();
+}
+
+bool JobServer::listen(const QString& name) {
+	// socket left by a crashed server is removed, the one of a running server is not
+	QLocalSocket probe;
+	probe.connectToServer(name);
+	if (probe.waitForConnected(500)) {
+		probe.disconnectFromServer();
+		return false;
+	}
+	QLocalServer::removeServer(name);
+	// jobs read and write files as this user, nobody else may connect
+	_server.setSocketOptions(QLocalServer::UserAccessOption);
+	return _server.listen(name);
+}
+
+void JobServer::send(QLocalSocket* client, const QString& id, const QString& event, QJsonObject message) {
+	if (!client) return;
+	message.insert("id", id);
+	message.insert("event", event);
+	client->write(QJsonDocument(message).toJson(QJsonDocument::Compact) + '\n');
+}
+
+// optional integer field, false with the error if it's not a number in the range
+static bool readInt(const QJsonObject& request, const QString& name, int min, int max, int& value, QString& error) {
+	if (!request.contains(name)) return true;
+	QJsonValue field = request.value(name);
+	double number = field.toDouble();
+	if (!field.isDouble() || number < min || number > max || number != floor(number)) {
+		error = QString("%1 must be an integer from %2 to %3").arg(name).arg(min).arg(max);
+		return false;
+	}
+	value = static_cast<int>(number);
+	return true;
+}
+
+bool JobServer::parseJob(const QJsonObject& request, Job& job, QString& error) const {
+	job.id = request.value("id").toString();
+	if (job.id.isEmpty()) {
+		error = "missing id";
+		return false;
+	}
+	QJsonArray images = request.value("images").toArray();
+	for (QJsonArray::ConstIterator it = images.begin(); it != images.end(); ++it)
+		job.images.append((*it).toString());
+	if (job.images.isEmpty()) {
+		error = "no images";
+		return false;
+	}
+
+	// same parameter names as the command line options
+	job.params = _defaults;
+	job.params.out_dir = request.value("outputDir").toString(QFileInfo(job.images.first()).absolutePath());
+	if (!QDir(job.params.out_dir).exists()) {
+		error = "output directory doesn't exist";
+		return false;
+	}
+	job.params.resume = request.value("resume").toBool(job.params.resume);
+	// same ranges as the spin boxes
+	LinesParameters& main = job.params.mainAlgo;
+	if (!readInt(request, "length", 1, 100000, main.line_length, error) ||
+		!readInt(request, "thickness", 0, 99, main.line_thickness, error) ||
+		!readInt(request, "iter", 1, 999999999, main.iterations, error) ||
+		!readInt(request, "angle1", 0, 90, main.angle1, error) ||
+		!readInt(request, "angle2", 0, 90, main.angle2, error))
+		return false;
+	if (main.angle1 > main.angle2) {
+		error = "angle1 must not be bigger than angle2";
+		return false;
+	}
+	if (request.contains("coverage")) {
+		double coverage = request.value("coverage").toDouble(-1);
+		if (coverage < 0 || coverage > 100) {
+			error = "coverage must be from 0 to 100";
+			return false;
+		}
+		main.min_coverage = static_cast<float>(coverage / 100.0);
+	}
+	if (request.contains("density")) {
+		// 0 keeps the fixed iterations
+		double density = request.value("density").toDouble(-1);
+		if (density < 0) {
+			error = "density must be a number, 0 or more";
+			return false;
+		}
+		main.sampling_density = static_cast<float>(density);
+	}
+	return true;
+}
+
+bool JobServer::cancelJob(const QString& id, QLocalSocket* client) {
+	if (_busy && _running.id == id && _running.client == client) {
+		// done is sent when the algorithm stops
+		_cancelled = true;
+		_algo.stop();
+		return true;
+	}
+	for (QQueue<Job>::Iterator it = _jobs.begin(); it != _jobs.end(); ++it)
+		if (it->id == id && it->client == client) {
+			_jobs.erase(it);
+			send(client, id, "done", QJsonObject{ { "cancelled", true }, { "results", QJsonArray() } });
+			return true;
+		}
+	return false;
+}
+
+void JobServer::startNext() {
+	if (_busy) return;
+	// jobs of disconnected clients are dropped
+	while (!_jobs.isEmpty() && !_jobs.head().client)
+		_jobs.dequeue();
+	if (_jobs.isEmpty()) return;
+
+	_running = _jobs.dequeue();
+	_busy = true;
+	_cancelled = false;
+	_progress = 0;
+	send(_running.client, _running.id, "started");
+	_algo.start(_running.images, _running.params);
+}
+
+void JobServer::onNewConnection() {
+	while (QLocalSocket* client = _server.nextPendingConnection()) {
+		connect(client, &QLocalSocket::readyRead, this, &JobServer::onReadyRead);
+		connect(client, &QLocalSocket::disconnected, this, &JobServer::onDisconnected);
+	}
+}
+
+void JobServer::onReadyRead() {
+	QLocalSocket* client = qobject_cast<QLocalSocket*>(sender());
+	if (!client) return;
+
+	while (client->canReadLine()) {
+		QByteArray line = client->readLine().trimmed();
+		if (line.isEmpty()) continue;
+
+		QJsonParseError parseError;
+		QJsonDocument doc = QJsonDocument::fromJson(line, &parseError);
+		if (!doc.isObject()) {
+			send(client, QString(), "error", QJsonObject{ { "message", doc.isNull() ? parseError.errorString() : "not an object" } });
+			continue;
+		}
+		QJsonObject request = doc.object();
+		QString id = request.value("id").toString();
+
+		if (request.value("cancel").toBool()) {
+			if (!cancelJob(id, client))
+				send(client, id, "error", QJsonObject{ { "message", "no such job" } });
+			continue;
+		}
+
+		Job job;
+		QString error;
+		if (!parseJob(request, job, error)) {
+			send(client, id, "error", QJsonObject{ { "message", error } });
+			continue;
+		}
+		job.client = client;
+		_jobs.enqueue(job);
+		send(client, id, "queued", QJsonObject{ { "position", _jobs.size() - 1 + (_busy ? 1 : 0) } });
+		startNext();
+	}
+}
+
+void JobServer::onDisconnected() {
+	QLocalSocket* client = qobject_cast<QLocalSocket*>(sender());
+	if (!client) return;
+	// nobody waits for the running job anymore
+	if (_busy && _running.client == client) {
+		_cancelled = true;
+		_algo.stop();
+	}
+	client->deleteLater();
+}
+
+void JobServer::onProgressMade(int progress) {
+	_progress = progress;
+}
+
+void JobServer::onEtaUpdated(const QString& status) {
+	// cleared when the run ends
+	if (!_busy || status.isEmpty()) return;
+	send(_running.client, _running.id, "progress", QJsonObject{ { "progress", _progress }, { "status", status } });
+}
+
+void JobServer::onImageFinished(const QString& image) {
+	if (!_busy) return;
+	send(_running.client, _running.id, "image", QJsonObject{ { "image", image } });
+}
+
+void JobServer::onAlgoFinished() {
+	if (!_busy) return;
+
+	// the report of a resumed job has the journaled results of other images in the directory too
+	QSet<QString> paths;
+	for (QStringList::ConstIterator it = _running.images.begin(); it != _running.images.end(); ++it)
+		paths.insert(QFileInfo(*it).absoluteFilePath());
+	QJsonArray results;
+	const Report& report = _algo.report();
+	for (size_t i = 0; i < report.results.size(); i++) {
+		if (!paths.contains(report.results[i].path)) continue;
+		QJsonArray percent, count;
+		for (int cls = 0; cls < 3; cls++) {
+			percent.append(report.results[i].percent[cls]);
+			count.append(report.results[i].count[cls]);
+		}
+		results.append(QJsonObject{ { "image", report.results[i].fileName }, { "percent", percent }, { "count", count } });
+	}
+	send(_running.client, _running.id, "done", QJsonObject{ { "cancelled", _cancelled }, { "results", results } });
+
+	_busy = false;
+	startNext();
+}
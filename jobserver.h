@@ -0,0 +1,94 @@
+/*
+* BioLines (https://github.com/mmuszkow/BioLines)
+* Detection of filamentous structures in biological microscopic images
+* Copyright(C) 2017 Maciek Muszkowski
+*
+* This program is free software : you can redistribute it and / or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef JOBSERVER_H
+#define JOBSERVER_H
+
+#include <QObject>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QJsonObject>
+#include <QPointer>
+#include <QQueue>
+#include "algorithm.h"
+
+// Long-running local service, clients connect to the named local socket (named pipe on Windows, Unix socket
+// elsewhere) and send jobs as JSON objects, one per line:
+//   {"id": "job1", "images": ["a.lsm", "b.lsm"], "outputDir": "out", "iter": 100000, ...}
+// optional keys override the parameters the server was started with: outputDir (the first image directory
+// by default), resume, length, thickness, iter, angle1, angle2, coverage (%), density
+//   {"id": "job1", "cancel": true}
+// cancels a queued or running job. Jobs run one after another, the server answers with lines of:
+//   {"id", "event": "queued", "position"}, {"id", "event": "started"}, {"id", "event": "progress", "progress", "status"},
+//   {"id", "event": "image", "image"}, {"id", "event": "done", "cancelled", "results": [{"image", "percent", "count"}]},
+//   {"id", "event": "error", "message"}
+// The worker threads are kept between the jobs.
+class JobServer : public QObject
+{
+	Q_OBJECT
+
+private:
+	struct Job {
+		QString id;
+		QStringList images;
+		AlgorithmWorker::Parameters params;
+		// replies go here, null once the client disconnects
+		QPointer<QLocalSocket> client;
+	};
+
+	QLocalServer _server;
+	Algorithm _algo;
+	// parameters the jobs override
+	AlgorithmWorker::Parameters _defaults;
+	QQueue<Job> _jobs;
+	Job _running;
+	bool _busy, _cancelled;
+	int _progress;
+
+	// sends a message line to the client, the id and event are added to it
+	static void send(QLocalSocket* client, const QString& id, const QString& event, QJsonObject message = QJsonObject());
+	// job from a request, false and the error message if it's not valid
+	bool parseJob(const QJsonObject& request, Job& job, QString& error) const;
+	// cancels the job, false if there's no such job of the client
+	bool cancelJob(const QString& id, QLocalSocket* client);
+	// starts the first queued job if nothing is running
+	void startNext();
+
+private slots:
+	void onNewConnection();
+	void onReadyRead();
+	void onDisconnected();
+	void onProgressMade(int progress);
+	void onEtaUpdated(const QString& status);
+	void onImageFinished(const QString& image);
+	void onAlgoFinished();
+
+public:
+	JobServer(const AlgorithmWorker::Parameters& defaults, QObject *parent = 0);
+	~JobServer();
+
+	// starts listening, false if the name is taken by a running server
+	bool listen(const QString& name);
+	inline QString errorString() const {
+		return _server.errorString();
+	}
+};
+
+#endif // JOBSERVER_H
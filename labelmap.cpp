@@ -0,0 +1,74 @@
+/*
+* BioLines (https://github.com/mmuszkow/BioLines)
+* Detection of filamentous structures in biological microscopic images
+* Copyright(C) 2017 Maciek Muszkowski
+*
+* This program is free software : you can redistribute it and / or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "stdafx.h"
+#include "labelmap.h"
+
+cv::Mat LabelMap::fromOutput(const LinesOutput& output, const LinesParameters& params) {
+	cv::Mat labels;
+	fromOutput(output, params, labels);
+	return labels;
+}
+
+void LabelMap::fromOutput(const LinesOutput& output, const LinesParameters& params, cv::Mat& labels) {
+	labels.create(output.all.rows, output.all.cols, CV_8UC1);
+	for (int y = 0; y < labels.rows; y++) {
+		const cv::Vec3b* c1 = output.color1.ptr<cv::Vec3b>(y);
+		const cv::Vec3b* c2 = output.color2.ptr<cv::Vec3b>(y);
+		const cv::Vec3b* c3 = output.color3.ptr<cv::Vec3b>(y);
+		const cv::Vec3b* all = output.all.ptr<cv::Vec3b>(y);
+		uchar* label = labels.ptr<uchar>(y);
+		for (int x = 0; x < labels.cols; x++) {
+			uchar l = 0;
+			if (c1[x] != BLACK) l |= 1;
+			if (c2[x] != BLACK) l |= 2;
+			if (c3[x] != BLACK) l |= 4;
+			// last drawn line wins in the combined image
+			if (all[x] != BLACK)
+				l |= (all[x] == params.color1 ? 1 : (all[x] == params.color2 ? 2 : 3)) << COMBINED_SHIFT;
+			label[x] = l;
+		}
+	}
+}
+
+cv::Mat LabelMap::classImage(const cv::Mat& labels, int cls, const cv::Vec3b& color) {
+	cv::Mat img(labels.rows, labels.cols, CV_8UC3, cv::Scalar(0, 0, 0));
+	uchar bit = 1 << cls;
+	for (int y = 0; y < labels.rows; y++) {
+		const uchar* label = labels.ptr<uchar>(y);
+		cv::Vec3b* px = img.ptr<cv::Vec3b>(y);
+		for (int x = 0; x < labels.cols; x++)
+			if (label[x] & bit) px[x] = color;
+	}
+	return img;
+}
+
+cv::Mat LabelMap::combinedImage(const cv::Mat& labels, const LinesParameters& params) {
+	cv::Mat img(labels.rows, labels.cols, CV_8UC3, cv::Scalar(0, 0, 0));
+	for (int y = 0; y < labels.rows; y++) {
+		const uchar* label = labels.ptr<uchar>(y);
+		cv::Vec3b* px = img.ptr<cv::Vec3b>(y);
+		for (int x = 0; x < labels.cols; x++) {
+			int top = label[x] >> COMBINED_SHIFT;
+			if (top) px[x] = params.color(top - 1);
+		}
+	}
+	return img;
+}
@@ -0,0 +1,43 @@
+/*
+* BioLines (https://github.com/mmuszkow/BioLines)
+* Detection of filamentous structures in biological microscopic images
+* Copyright(C) 2017 Maciek Muszkowski
+*
+* This program is free software : you can redistribute it and / or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include "linedetector.h"
+
+// Single 8-bit map of all the classes, bit per class marks its lines and two more bits which class
+// is on top in the combined image, all the colored outputs can be rendered back from it
+class LabelMap {
+public:
+	// bits of the classes lines, class 1 is the lowest
+	static const uchar CLASSES_MASK = 0x07;
+	// class shown in the combined image, 1-3, 0 - none
+	static const int COMBINED_SHIFT = 4;
+
+	// label map of the detected lines, colors of the classes tell which class is on top in the combined image
+	static cv::Mat fromOutput(const LinesOutput& output, const LinesParameters& params);
+	// same, written into labels, which memory is reused if it's 8-bit of the output size
+	static void fromOutput(const LinesOutput& output, const LinesParameters& params, cv::Mat& labels);
+
+	// lines of the class (0-2) in the given color, like LinesOutput::classImg
+	static cv::Mat classImage(const cv::Mat& labels, int cls, const cv::Vec3b& color);
+	// all classes together, like LinesOutput::all
+	static cv::Mat combinedImage(const cv::Mat& labels, const LinesParameters& params);
+};
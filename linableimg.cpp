@@ -34,27 +34,9 @@ void LinableImg::_handle(Line& res, int y, int x, const cv::Vec3b& color, bool d
 
 LinableImg::Line LinableImg::_line(int x0, int y0, int x1, int y1, const cv::Vec3b& color, int w, bool draw) {
 	Line res;
-	int dx = abs(x1 - x0), sx = x0 < x1 ? 1 : -1;
-	int dy = abs(y1 - y0), sy = y0 < y1 ? 1 : -1;
-	int err = dx - dy, e2, x2, y2;                           /* error value e_xy */
-	float ed = dx + dy == 0 ? 1 : sqrt((float)dx*dx + (float)dy*dy);
-	float wd = static_cast<float>(w);
-	for (wd = (wd + 1) / 2;;) {                                    /* pixel loop */
-		_handle(res, y0, x0, color, draw);
-		e2 = err; x2 = x0;
-		if (2 * e2 >= -dx) {                                            /* x step */
-			for (e2 += dy, y2 = y0; e2 < ed*wd && (y1 != y2 || dx > dy); e2 += dx)
-				_handle(res, y2 += sy, x0, color, draw);
-			if (x0 == x1) break;
-			e2 = err; err -= dy; x0 += sx;
-		}
-		if (2 * e2 <= dy) {                                             /* y step */
-			for (e2 = dx - e2; e2 < ed*wd && (x1 != x2 || dx < dy); e2 += dy)
-				_handle(res, y0, x2 += sx, color, draw);
-			if (y0 == y1) break;
-			err += dx; y0 += sy;
-		}
-	}
+	_walk(x0, y0, x1, y1, w, [&](int y, int x) {
+		_handle(res, y, x, color, draw);
+	});
 	return res;
 }
 
@@ -66,3 +48,58 @@ int LinableImg::count(const cv::Vec3b& color) const {
 				count++;
 	return count;
 }
+
+LinableImg::Stencil::Stencil(int dx, int dy, int w) : dx(dx), dy(dy), minX(0), minY(0), maxX(0), maxY(0) {
+	_walk(0, 0, dx, dy, w, [&](int y, int x) {
+		offsets.push_back(cv::Point(x, y));
+		minX = std::min(minX, x);
+		minY = std::min(minY, y);
+		maxX = std::max(maxX, x);
+		maxY = std::max(maxY, y);
+	});
+}
+
+float LinableImg::coverage(const Stencil& stencil, int x, int y) const {
+	int white = 0, total = 0;
+	if (stencil.inside(x, y, this->cols, this->rows)) {
+		for (std::vector<cv::Point>::const_iterator it = stencil.offsets.begin(); it != stencil.offsets.end(); ++it)
+			if (this->at<cv::Vec3b>(y + it->y, x + it->x) == WHITE)
+				white++;
+		total = static_cast<int>(stencil.offsets.size());
+	} else {
+		// clipped same as in _handle
+		for (std::vector<cv::Point>::const_iterator it = stencil.offsets.begin(); it != stencil.offsets.end(); ++it) {
+			int px = x + it->x, py = y + it->y;
+			if (px < 0 || py < 0 || px >= this->cols || py >= this->rows) continue;
+			total++;
+			if (this->at<cv::Vec3b>(py, px) == WHITE)
+				white++;
+		}
+	}
+	return white / static_cast<float>(total);
+}
+
+void LinableImg::line(const Stencil& stencil, int x, int y, const cv::Vec3b& color) {
+	bool inside = stencil.inside(x, y, this->cols, this->rows);
+	for (std::vector<cv::Point>::const_iterator it = stencil.offsets.begin(); it != stencil.offsets.end(); ++it) {
+		int px = x + it->x, py = y + it->y;
+		if (!inside && (px < 0 || py < 0 || px >= this->cols || py >= this->rows)) continue;
+		this->at<cv::Vec3b>(py, px) = color;
+	}
+}
+
+void LinableImg::line(cv::Mat& mask, int x0, int y0, int x1, int y1, int w) {
+	_walk(x0, y0, x1, y1, w, [&](int y, int x) {
+		if (x < 0 || y < 0 || x >= mask.cols || y >= mask.rows) return;
+		mask.at<uchar>(y, x) = 255;
+	});
+}
+
+void LinableImg::line(cv::Mat& mask, const Stencil& stencil, int x, int y) {
+	bool inside = stencil.inside(x, y, mask.cols, mask.rows);
+	for (std::vector<cv::Point>::const_iterator it = stencil.offsets.begin(); it != stencil.offsets.end(); ++it) {
+		int px = x + it->x, py = y + it->y;
+		if (!inside && (px < 0 || py < 0 || px >= mask.cols || py >= mask.rows)) continue;
+		mask.at<uchar>(py, px) = 255;
+	}
+}
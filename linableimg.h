@@ -21,6 +21,7 @@
 #pragma once
 
 #include "stdafx.h"
+#include <vector>
 
 class LinableImg : public cv::Mat {
 	struct Line {
@@ -33,6 +34,32 @@ class LinableImg : public cv::Mat {
 	void _handle(Line& res, int y, int x, const cv::Vec3b& color, bool draw);
 	Line _line(int x0, int y0, int x1, int y1, const cv::Vec3b& color, int w, bool draw);
 
+	// thick Bresenham line, calls visit(y, x) for every pixel, some pixels are visited twice
+	template <typename Visit>
+	static void _walk(int x0, int y0, int x1, int y1, int w, Visit visit) {
+		int dx = abs(x1 - x0), sx = x0 < x1 ? 1 : -1;
+		int dy = abs(y1 - y0), sy = y0 < y1 ? 1 : -1;
+		int err = dx - dy, e2, x2, y2;                           /* error value e_xy */
+		float ed = dx + dy == 0 ? 1 : sqrt((float)dx*dx + (float)dy*dy);
+		float wd = static_cast<float>(w);
+		for (wd = (wd + 1) / 2;;) {                                    /* pixel loop */
+			visit(y0, x0);
+			e2 = err; x2 = x0;
+			if (2 * e2 >= -dx) {                                            /* x step */
+				for (e2 += dy, y2 = y0; e2 < ed*wd && (y1 != y2 || dx > dy); e2 += dx)
+					visit(y2 += sy, x0);
+				if (x0 == x1) break;
+				e2 = err; err -= dy; x0 += sx;
+			}
+			if (2 * e2 <= dy) {                                             /* y step */
+				for (e2 = dx - e2; e2 < ed*wd && (x1 != x2 || dx < dy); e2 += dy)
+					visit(y0, x2 += sx);
+				if (y0 == y1) break;
+				err += dx; y0 += sy;
+			}
+		}
+	}
+
 public:
 	LinableImg(const Mat& img) : Mat(img) {
 		cvtColor(img, *this, cv::COLOR_GRAY2BGR);
@@ -53,4 +80,28 @@ public:
 	}
 
 	int count(const cv::Vec3b& color) const;
+
+	// pixels of a line relative to its start, in the same order and with the same repeats as _line visits them,
+	// so coverage and drawing through the stencil give exactly the same results, but without the Bresenham steps
+	struct Stencil {
+		// line end relative to the start
+		int dx, dy;
+		std::vector<cv::Point> offsets;
+		// bounding box of the offsets
+		int minX, minY, maxX, maxY;
+
+		Stencil(int dx, int dy, int w);
+
+		// no clipping needed for line starting there
+		inline bool inside(int x, int y, int cols, int rows) const {
+			return x + minX >= 0 && y + minY >= 0 && x + maxX < cols && y + maxY < rows;
+		}
+	};
+
+	float coverage(const Stencil& stencil, int x, int y) const;
+	void line(const Stencil& stencil, int x, int y, const cv::Vec3b& color);
+
+	// same lines drawn into 8-bit mask (255)
+	static void line(cv::Mat& mask, int x0, int y0, int x1, int y1, int w);
+	static void line(cv::Mat& mask, const Stencil& stencil, int x, int y);
 };
@@ -0,0 +1,151 @@
+/*
+* BioLines (https://github.com/mmuszkow/BioLines)
+* Detection of filamentous structures in biological microscopic images
+* Copyright(C) 2017 Maciek Muszkowski
+*
+* This program is free software : you can redistribute it and / or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "stdafx.h"
+#include "linedetector.h"
+#include "candidatestore.h"
+
+const char* DetectionStats::stopReasonName(StopReason reason) {
+	static const char* names[] = { "iterations", "cutoff", "deadline", "converged", "cancelled" };
+	return names[reason];
+}
+
+int LineDetector::budget(const LinesParameters& params, int foreground, bool hasDeadline) {
+	if (params.sampling_density > 0) {
+		// enough candidates for each foreground pixel to be covered by the given number of lines on average
+		double iterations = params.sampling_density * foreground / std::max(1, params.line_length);
+		return static_cast<int>(std::min<double>(std::max<double>(iterations, MIN_AUTO_ITERATIONS), MAX_AUTO_ITERATIONS));
+	}
+	// with a time budget we run until the deadline
+	if (hasDeadline) return INT_MAX;
+	return params.iterations;
+}
+
+LinesOutput LineDetector::detect(const cv::Mat& bin) {
+	const LinesParameters& params = _params;
+
+	LinesOutput output(bin);
+	float whiteCount = output.bin.count(WHITE);
+	output.stats.foreground = static_cast<int>(whiteCount);
+#ifdef BIOLINES_DEBUG_DUMPS
+	int dbgImgDumpIter[9];
+	for (int dd = 1; dd <= 9; dd++)
+		dbgImgDumpIter[dd-1] = dd * (budget(params, output.stats.foreground, _hasDeadline) / 10);
+	if (!_debugDir.empty())
+		imwrite(_debugDir + "/dl_" + std::to_string(params.line_length) + "_input.png", bin);
+#endif
+	// counters already added to the live progress
+	int publishedCandidates = 0, publishedAccepted = 0;
+	// precision of the classes shares
+	ConvergenceMonitor convergence;
+
+	int iterations = budget(params, output.stats.foreground, _hasDeadline);
+	output.stats.budget = iterations == INT_MAX ? -1 : iterations;
+	if (_progress && iterations != INT_MAX)
+		_progress->budget.fetch_add(iterations, std::memory_order_relaxed);
+	if (_candidates)
+		_candidates->begin(bin.cols, bin.rows, params, _angleOffset);
+	for (int i = 0; i < iterations; i++) {
+		if (_shouldStop.load(std::memory_order_relaxed)) {
+			output.stats.stopReason = DetectionStats::Cancelled;
+			return output;
+		}
+		if (_hasDeadline && (i & (DEADLINE_CHECK_INTERVAL - 1)) == 0 && i > 0 && Clock::now() >= _deadline) {
+			output.stats.stopReason = DetectionStats::Deadline;
+			break;
+		}
+		output.stats.candidates++;
+		int x1 = rand() % bin.cols;
+		int y1 = rand() % bin.rows;
+		int x2, y2, angle;
+		do {
+			angle = rand() % 360;
+			x2 = x1 + params.line_length * cos(deg2rad(angle));
+			y2 = y1 + params.line_length * sin(deg2rad(angle));
+		} while ((x1 == x2 && y1 == y2)
+			|| x1 == x2
+			|| x1 < 0 || y1 < 0 || x2 < 0 || y2 < 0
+			|| x1 >= bin.cols || y1 >= bin.rows || x2 >= bin.cols || y2 >= bin.rows);
+
+		float coverage = output.bin.coverage(x1, y1, x2, y2, params.line_thickness);
+		if (_candidates)
+			_candidates->add(i, x1, y1, angle, coverage);
+		int cls = -1;
+		if (coverage > params.min_coverage) {
+			// angle relative to the image orientation, same as if the image was rotated by the offset
+			float classAngle = offsetAngle(angle, _angleOffset);
+			cls = params.classify(classAngle);
+
+			output.stats.accepted++;
+			output.stats.angles[static_cast<int>(classAngle) % 360]++;
+			output.stats.coverageSum += coverage;
+
+			const cv::Vec3b& color = params.color(cls);
+			output.classImg(cls).line(x1, y1, x2, y2, params.line_thickness, color);
+			output.all.line(x1, y1, x2, y2, params.line_thickness, color);
+			if (_edgeMask && cls != 1)
+				LinableImg::line(*_edgeMask, x1, y1, x2, y2, params.line_thickness);
+			if (_collectSegments) {
+				Segment segment = { x1, y1, x2, y2, classAngle, cls, coverage };
+				output.segments.push_back(segment);
+			}
+		}
+
+#ifdef BIOLINES_DEBUG_DUMPS
+		for(int dd = 0; dd < 9; dd++)
+			if (i == dbgImgDumpIter[dd]) {
+				if (!_debugDir.empty())
+					imwrite(_debugDir + "/dl_" + std::to_string(params.line_length) + "_" + std::to_string(i) + ".png", output.all);
+				break;
+			}
+#endif
+
+		// stop when the classes shares are precise enough
+		if (convergence.add(cls) && params.tolerance > 0) {
+			double halfWidth = convergence.halfWidth();
+			if (halfWidth >= 0 && halfWidth * 100 <= params.tolerance) {
+				output.stats.stopReason = DetectionStats::Converged;
+				break;
+			}
+		}
+
+		// live progress
+		if (_progress && output.stats.candidates - publishedCandidates >= PUBLISH_INTERVAL) {
+			_progress->iterations.fetch_add(output.stats.candidates - publishedCandidates, std::memory_order_relaxed);
+			_progress->accepted.fetch_add(output.stats.accepted - publishedAccepted, std::memory_order_relaxed);
+			publishedCandidates = output.stats.candidates;
+			publishedAccepted = output.stats.accepted;
+		}
+
+		// cutoff
+		if (i % CUTOFF_CHECK_INTERVAL == 0 && cutoff(output.all, params, whiteCount)) {
+			output.stats.stopReason = DetectionStats::Cutoff;
+			break;
+		}
+	}
+
+	output.stats.precision = static_cast<float>(convergence.halfWidth() * 100);
+	if (_candidates)
+		_candidates->finish(output.stats);
+	if (_progress) {
+		_progress->iterations.fetch_add(output.stats.candidates - publishedCandidates, std::memory_order_relaxed);
+		_progress->accepted.fetch_add(output.stats.accepted - publishedAccepted, std::memory_order_relaxed);
+	}
+	return output;
+}
@@ -0,0 +1,237 @@
+/*
+* BioLines (https://github.com/mmuszkow/BioLines)
+* Detection of filamentous structures in biological microscopic images
+* Copyright(C) 2017 Maciek Muszkowski
+*
+* This program is free software : you can redistribute it and / or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <string>
+#include "linableimg.h"
+#include "progress.h"
+#include "convergence.h"
+
+// Statistics collected during the lines detection pass of a single image
+struct DetectionStats {
+	// why the detection loop ended
+	enum StopReason {
+		// all iterations done
+		IterationsDone,
+		// 95% of the foreground covered by lines
+		Cutoff,
+		// time budget exceeded
+		Deadline,
+		// classes shares precise enough
+		Converged,
+		// stopped by the user
+		Cancelled
+	};
+
+	// evaluated candidate lines, one per iteration
+	int candidates;
+	// candidates with coverage above the threshold
+	int accepted;
+	// accepted lines per angle in degrees (0-359)
+	int angles[360];
+	// sum of the accepted lines coverage
+	double coverageSum;
+	// white pixels in the binarized image
+	int foreground;
+	StopReason stopReason;
+	// 95% confidence interval half-width of the classes shares among accepted lines in percentage points,
+	// negative if there were too few candidates to estimate it
+	float precision;
+	// iterations limit of the detection, -1 when run until a deadline
+	int budget;
+
+	DetectionStats() : candidates(0), accepted(0), coverageSum(0), foreground(0), stopReason(IterationsDone), precision(-1), budget(0) {
+		memset(angles, 0, sizeof(angles));
+	}
+
+	inline int rejected() const {
+		return candidates - accepted;
+	}
+
+	inline double meanCoverage() const {
+		return accepted > 0 ? coverageSum / accepted : 0;
+	}
+
+	static const char* stopReasonName(StopReason reason);
+};
+
+struct LinesParameters {
+	// colors
+	cv::Vec3b color1, color2, color3;
+	// drawn line length
+	int line_length;
+	// how thick is the drawn line
+	int line_thickness;
+	// how many times we try to draw lines
+	int iterations;
+	// angles ranges for colors
+	int angle1, angle2;
+	// min white pixels under the line to keep it
+	float min_coverage;
+	// stop when the classes shares confidence interval half-width is below it, in percentage points, 0 - off
+	float tolerance;
+	// iterations scaled per image, candidate line lengths per foreground pixel, 0 - off (fixed iterations)
+	float sampling_density;
+
+	// class of a line by its angle in degrees (0-360), 0 - 1st, 1 - 2nd, 2 - 3rd
+	inline int classify(float angle) const {
+		if ((angle < angle1)
+			|| (angle >= 360 - angle1)
+			|| (angle >= 180 - angle1 && angle < 180 + angle1))
+			return 0;
+		if ((angle < angle2)
+			|| (angle >= 360 - angle2)
+			|| (angle >= 180 - angle2 && angle < 180 + angle2))
+			return 1;
+		return 2;
+	}
+
+	inline const cv::Vec3b& color(int cls) const {
+		return cls == 0 ? color1 : (cls == 1 ? color2 : color3);
+	}
+};
+
+// line angle minus the offset, wrapped to 0-360
+static inline float offsetAngle(int angle, float offset) {
+	float res = angle - offset;
+	if (res < 0) res += 360;
+	else if (res >= 360) res -= 360;
+	return res;
+}
+
+// accepted line, as drawn
+struct Segment {
+	int x1, y1, x2, y2;
+	// angle relative to the image orientation (auto-rotation offset applied), the class is decided by it
+	float angle;
+	// 0 - 1st, 1 - 2nd, 2 - 3rd
+	int cls;
+	float coverage;
+};
+
+// main algorithm output
+struct LinesOutput {
+	LinableImg 	bin, color1, color2, color3, all;
+	// collected during detection, at no extra cost
+	DetectionStats stats;
+	// accepted lines in the order they were drawn, only if requested
+	std::vector<Segment> segments;
+
+	LinesOutput(const cv::Mat& bin) :
+		bin(bin),
+		color1(bin.size), color2(bin.size), color3(bin.size), all(bin.size) { }
+
+	inline LinableImg& classImg(int cls) {
+		return cls == 0 ? color1 : (cls == 1 ? color2 : color3);
+	}
+};
+
+class CandidateStore;
+
+// Main algorithm, draws random lines and keeps those which cover enough white pixels of the binarized image,
+// lines are classified by their angle, independent from Qt and files so it can be benchmarked and reused
+class LineDetector {
+public:
+	typedef std::chrono::steady_clock Clock;
+
+private:
+	const LinesParameters& _params;
+	const std::atomic<bool>& _shouldStop;
+	// where to dump intermediate images in debug builds, empty - no dumps
+	std::string _debugDir;
+	// live counters, may be NULL
+	ImageProgress* _progress;
+
+	// 8-bit mask the class 1 and class 3 lines are also drawn into, may be NULL
+	cv::Mat* _edgeMask;
+	// subtracted from the lines angles before classifying them, in degrees
+	float _angleOffset;
+	// time budget, if set
+	bool _hasDeadline;
+	Clock::time_point _deadline;
+	// accepted lines are also kept as segments
+	bool _collectSegments;
+	// every candidate is also stored here, may be NULL
+	CandidateStore* _candidates;
+
+	// auto-scaled iterations limits
+	static const int MIN_AUTO_ITERATIONS = 10000;
+	static const int MAX_AUTO_ITERATIONS = 100000000;
+
+public:
+	// how many iterations between publishing the live counters
+	static const int PUBLISH_INTERVAL = 1024;
+	// how many iterations between reading the clock when there is a deadline, must be power of 2
+	static const int DEADLINE_CHECK_INTERVAL = 1024;
+	// how many iterations between checking the 95% cutoff
+	static const int CUTOFF_CHECK_INTERVAL = 100000;
+
+	// 95% of the foreground covered by lines
+	static inline bool cutoff(const LinableImg& all, const LinesParameters& params, float whiteCount) {
+		float nonWhiteCount = all.count(params.color1) + all.count(params.color2) + all.count(params.color3);
+		return nonWhiteCount / (whiteCount + 1) >= 0.95;
+	}
+
+	// degrees to radians
+	static inline float deg2rad(float degrees) {
+		return (degrees * M_PI) / 180.0f;
+	}
+
+	// iterations limit for the image, from parameters or scaled by the foreground size, INT_MAX if run until deadline
+	static int budget(const LinesParameters& params, int foreground, bool hasDeadline);
+
+	LineDetector(const LinesParameters& params, const std::atomic<bool>& stopFlag,
+		const std::string& debugDir = std::string(), ImageProgress* progress = NULL) :
+		_params(params), _shouldStop(stopFlag), _debugDir(debugDir), _progress(progress), _edgeMask(NULL), _angleOffset(0), _hasDeadline(false), _collectSegments(false), _candidates(NULL) {}
+
+	// cell walls detection, class 1 and 3 lines are the cell edges
+	inline void setEdgeMask(cv::Mat* mask) {
+		_edgeMask = mask;
+	}
+
+	// lines are classified as if the image was rotated counter-clockwise by the angle (cv::getRotationMatrix2D),
+	// so the image doesn't have to be warped
+	inline void setAngleOffset(float degrees) {
+		_angleOffset = degrees;
+	}
+
+	// detection runs until the cutoff or the deadline, iterations limit is no longer used
+	inline void setDeadline(const Clock::time_point& deadline) {
+		_deadline = deadline;
+		_hasDeadline = true;
+	}
+
+	// keep the accepted lines in LinesOutput::segments
+	inline void setCollectSegments(bool collect) {
+		_collectSegments = collect;
+	}
+
+	// keep every evaluated candidate, so the lines can be classified again without the detection
+	inline void setCandidateStore(CandidateStore* store) {
+		_candidates = store;
+	}
+
+	// bin is 8-bit binarized image (0 or 255)
+	LinesOutput detect(const cv::Mat& bin);
+};
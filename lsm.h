@@ -35,7 +35,7 @@ struct tiff_header {
 	/* Always 42 */
 	uint16_t version;
 	/* Offset of the first IFD. */
-	uint16_t first_ifd_offset;
+	uint32_t first_ifd_offset;
 };
 
 #define LSM_CHANNEL_COLORS_READ_SIZE (sizeof(struct lsm_channel_names_colors) - sizeof(char**) - sizeof(uint32_t*))
@@ -188,7 +188,7 @@ struct lsm_file {
 
 
 
-bool lsm_read_lsm_info(FILE* f, struct tiff_ifd* ifd, struct tiff_ifd_field* field) {
+static bool lsm_read_lsm_info(FILE* f, struct tiff_ifd* ifd, struct tiff_ifd_field* field) {
 
 	if (field->length < LSM_INFO_STRUCT_READ_SIZE)
 		return false;
@@ -262,7 +262,7 @@ bool lsm_read_lsm_info(FILE* f, struct tiff_ifd* ifd, struct tiff_ifd_field* fie
 	return true;
 }
 
-void lsm_free(struct lsm_file* lsm) {
+static void lsm_free(struct lsm_file* lsm) {
 	if (lsm->ifd) {
 		for (int ifd_idx = 0; ifd_idx < lsm->ifd_length; ifd_idx++) {
 			if (lsm->ifd[ifd_idx].tag_bits_per_sample) free(lsm->ifd[ifd_idx].tag_bits_per_sample);
@@ -281,7 +281,7 @@ void lsm_free(struct lsm_file* lsm) {
 	free(lsm);
 }
 
-struct lsm_file* lsm_open(FILE* f) {
+static struct lsm_file* lsm_open(FILE* f) {
 
 	if (!f)
 		return NULL;
@@ -310,8 +310,8 @@ struct lsm_file* lsm_open(FILE* f) {
 		return NULL;
 	}
 
-	// read IFDs count
-	uint16_t offset = header.first_ifd_offset;
+	// read IFDs count, offsets are 32-bit, LSM files are way bigger than 64k
+	uint32_t offset = header.first_ifd_offset;
 	lsm->ifd_length = 0;
 	while (offset != 0) {
 		uint16_t ifd_fields_count;
@@ -328,7 +328,7 @@ struct lsm_file* lsm_open(FILE* f) {
 			lsm_free(lsm);
 			return NULL;
 		}
-		if (fread(&offset, 2, 1, f) != 1) {
+		if (fread(&offset, 4, 1, f) != 1) {
 			lsm_free(lsm);
 			return NULL;
 		}
@@ -384,13 +384,18 @@ struct lsm_file* lsm_open(FILE* f) {
 						lsm_free(lsm);
 						return NULL;
 					}
-					if (fseek(f, field.offset, SEEK_SET) != 0) {
-						lsm_free(lsm);
-						return NULL;
-					}
-					if (fread(lsm->ifd[ifd_idx].tag_bits_per_sample, 2, field.length, f) != field.length) {
-						lsm_free(lsm);
-						return NULL;
+					// 1 or 2 values fit into the field itself
+					if (field.length <= 2)
+						memcpy(lsm->ifd[ifd_idx].tag_bits_per_sample, &field.offset, 2 * field.length);
+					else {
+						if (fseek(f, field.offset, SEEK_SET) != 0) {
+							lsm_free(lsm);
+							return NULL;
+						}
+						if (fread(lsm->ifd[ifd_idx].tag_bits_per_sample, 2, field.length, f) != field.length) {
+							lsm_free(lsm);
+							return NULL;
+						}
 					}
 				}
 				break;
@@ -398,7 +403,7 @@ struct lsm_file* lsm_open(FILE* f) {
 				lsm->ifd[ifd_idx].tag_compression = field.offset & 0xFF;
 				break;
 			case TIFF_TAG_PREDICTOR:
-				lsm->ifd[ifd_idx].tag_compression = field.offset & 0xFFFF;
+				lsm->ifd[ifd_idx].tag_predictor = field.offset & 0xFFFF;
 				break;
 			case TIFF_TAG_PHOTOMETRIC_INTERPRETATION:
 				lsm->ifd[ifd_idx].tag_photometric_interpretation = field.offset & 0xFFFF;
@@ -468,7 +473,7 @@ struct lsm_file* lsm_open(FILE* f) {
 			lsm_free(lsm);
 			return NULL;
 		}
-		if (fread(&offset, 2, 1, f) != 1) {
+		if (fread(&offset, 4, 1, f) != 1) {
 			lsm_free(lsm);
 			return NULL;
 		}
@@ -478,8 +483,17 @@ struct lsm_file* lsm_open(FILE* f) {
 	return lsm;
 }
 
-// free with free() after using
-void* lsm_read_pixel_data(FILE* f, struct tiff_ifd* ifd, int strip) {
+/* Index of the first IFD with (@reduced true) or without the reduced-resolution bit, -1 if there is none.
+   LSM stores a thumbnail after every full image. */
+static int lsm_find_ifd(struct lsm_file* lsm, bool reduced) {
+	for (int ifd_idx = 0; ifd_idx < lsm->ifd_length; ifd_idx++)
+		if (((lsm->ifd[ifd_idx].tag_new_subfile_type & TIFF_FILETYPE_REDUCEDIMAGE_MASK) != 0) == reduced)
+			return ifd_idx;
+	return -1;
+}
+
+// free with free() after using, @length is set to the data size in bytes
+static void* lsm_read_pixel_data(FILE* f, struct tiff_ifd* ifd, int strip, size_t* length) {
 	if (!f || !ifd || strip < 0 || strip >= ifd->tag_strip_offsets_length)
 		return NULL;
 
@@ -490,7 +504,7 @@ void* lsm_read_pixel_data(FILE* f, struct tiff_ifd* ifd, int strip) {
 		return NULL;
 
 	// LZW compression
-	if (ifd->tag_compression == TIFF_COMPRESSION_LZW && ifd->tag_predictor == 2) {
+	if (ifd->tag_compression == TIFF_COMPRESSION_LZW) {
 		struct lzw_buff* enc = lzw_buff_alloc(1, ifd->tag_strip_byte_counts[strip]);
 		if (!enc)
 			return NULL;
@@ -512,8 +526,19 @@ void* lsm_read_pixel_data(FILE* f, struct tiff_ifd* ifd, int strip) {
 		}
 
 		memcpy(data, &dec->data, dec->length);
+		*length = dec->length;
 		free(dec);
 
+		// horizontal differencing, 8-bit samples only, separate planes have 1 sample per pixel in a strip
+		if (ifd->tag_predictor == 2) {
+			size_t samples = ifd->tag_planar_configuration == 2 || ifd->tag_samples_per_pixel == 0 ? 1 : ifd->tag_samples_per_pixel;
+			size_t row = ifd->tag_image_width * samples;
+			uint8_t* px = (uint8_t*) data;
+			for (size_t y = 0; row > 0 && y + row <= *length; y += row)
+				for (size_t x = samples; x < row; x++)
+					px[y + x] += px[y + x - samples];
+		}
+
 		return data;
 	}
 
@@ -526,11 +551,12 @@ void* lsm_read_pixel_data(FILE* f, struct tiff_ifd* ifd, int strip) {
 		free(data);
 		return NULL;
 	}
+	*length = ifd->tag_strip_byte_counts[strip];
 
 	return data;
 }
 
-void lsm_print_info(struct lsm_file* lsm) {
+static void lsm_print_info(struct lsm_file* lsm) {
 	if (!lsm) {
 		puts("Not a proper .lsm file");
 		return;
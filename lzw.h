@@ -34,7 +34,7 @@ struct lzw_buff {
 };
 
 /* Initializes buffer with 0's. */
-struct lzw_buff* lzw_buff_alloc(size_t item_size, size_t length) {
+static struct lzw_buff* lzw_buff_alloc(size_t item_size, size_t length) {
     struct lzw_buff *buff = (struct lzw_buff*) calloc(1, sizeof(size_t) * 2 + item_size * length);
     buff->item_size = item_size;
     buff->length = length;
@@ -42,7 +42,7 @@ struct lzw_buff* lzw_buff_alloc(size_t item_size, size_t length) {
 };
 
 /* Extends or trims the buffer, new space is filled with 0's. */
-struct lzw_buff* _lzw_buff_resize(struct lzw_buff* buff, size_t new_length) {
+static struct lzw_buff* _lzw_buff_resize(struct lzw_buff* buff, size_t new_length) {
     size_t old_length = buff->length;
     buff = (struct lzw_buff*) realloc(buff, sizeof(size_t) * 2 + buff->item_size * new_length);
     if (new_length > old_length) {
@@ -88,7 +88,7 @@ struct lzw_dec_t {
 }
 
 /* inbuff is 8-bit buffer, function can produce 9-15 bits encoded strings (@max_bits) */
-struct lzw_buff* lzw_encode(struct lzw_buff* inbuff, int max_bits) {
+static struct lzw_buff* lzw_encode(struct lzw_buff* inbuff, int max_bits) {
     size_t len = inbuff->length;
     int bits = 9, next_shift = 512, out_len = 0, o_bits = 0;
     uint32_t tmp = 0;
@@ -134,6 +134,61 @@ struct lzw_buff* lzw_encode(struct lzw_buff* inbuff, int max_bits) {
     return outbuff;
 }
 
+/* TIFF flavour of lzw_encode (compression 5) for a single strip: starts with a clear code, code width
+   grows one code earlier ("early change"), codes are 12 bits max and the table is cleared when it's full */
+static struct lzw_buff* lzw_encode_tiff(const uint8_t* indata, size_t len) {
+    int bits = 9, out_len = 0, o_bits = 0;
+    uint32_t tmp = 0;
+    uint16_t code, c, nc, next_code = LZW_M_NEW;
+    struct lzw_buff* dbuff = lzw_buff_alloc(sizeof(struct lzw_enc_t), 512);
+    struct lzw_buff* outbuff = lzw_buff_alloc(2, len / 4 + 4);
+    uint8_t* outdata = (uint8_t*) &outbuff->data;
+    struct lzw_enc_t* d = (struct lzw_enc_t*) &dbuff->data;
+
+    _lzw_write_bits(LZW_M_CLR);
+    if (len) {
+        for (code = *(indata++); --len; ) {
+            c = *(indata++);
+            if ((nc = d[code].next[c]))
+                code = nc;
+            else {
+                _lzw_write_bits(code);
+                d[code].next[c] = next_code++;
+                code = c;
+
+                if (next_code == 4094) {
+                    _lzw_write_bits(LZW_M_CLR);
+                    bits = 9;
+                    next_code = LZW_M_NEW;
+                    /* shrink back, so only the used part is zeroed again */
+                    dbuff = _lzw_buff_resize(dbuff, 512);
+                    d = (struct lzw_enc_t*) &dbuff->data;
+                    _lzw_zero(dbuff);
+                } else if (next_code == (1 << bits)) {
+                    dbuff = _lzw_buff_resize(dbuff, 1 << ++bits);
+                    d = (struct lzw_enc_t*) &dbuff->data;
+                }
+            }
+        }
+        _lzw_write_bits(code);
+        /* the decoder adds an entry for the last code too */
+        if (++next_code == 4094) {
+            _lzw_write_bits(LZW_M_CLR);
+            bits = 9;
+        } else if (next_code == (1 << bits))
+            bits++;
+    }
+    _lzw_write_bits(LZW_M_EOD);
+    /* pad the last byte with 0's */
+    if (o_bits) {
+        bits = 8 - o_bits;
+        _lzw_write_bits(0);
+    }
+    free(dbuff);
+    outbuff = _lzw_buff_resize(outbuff, out_len);
+    return outbuff;
+}
+
 #define _lzw_write_out(c) { \
     if (out_len >= outbuff->length) { \
         outbuff = _lzw_buff_resize(outbuff, outbuff->length * 2); \
@@ -142,7 +197,7 @@ struct lzw_buff* lzw_encode(struct lzw_buff* inbuff, int max_bits) {
     outdata[out_len++] = c; }
 
 /* inbuff is 8-bit buffer */
-struct lzw_buff* lzw_decode(struct lzw_buff* inbuff) {
+static struct lzw_buff* lzw_decode(struct lzw_buff* inbuff) {
     struct lzw_buff* outbuff = lzw_buff_alloc(1, 4);
     struct lzw_buff* dbuff = lzw_buff_alloc(sizeof(struct lzw_dec_t), 512);
     uint8_t* indata = (uint8_t*) &inbuff->data;
@@ -215,7 +270,7 @@ bail: free(dbuff);
     return outbuff;
 }
 
-void lzw_test(uint8_t* buff, size_t length) {
+static void lzw_test(uint8_t* buff, size_t length) {
     float best_ratio = 99999;
     int best_bits = 0;
     struct lzw_buff* inbuff = lzw_buff_alloc(1, length);
@@ -38,6 +38,8 @@ int main(int argc, char *argv[])
 
 	if (argc > 1)
 		w.setArgs(a.arguments());
+	else
+		w.startPreview();
 
 	return a.exec();
 }
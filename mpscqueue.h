@@ -0,0 +1,73 @@
+/*
+* BioLines (https://github.com/mmuszkow/BioLines)
+* Detection of filamentous structures in biological microscopic images
+* Copyright(C) 2017 Maciek Muszkowski
+*
+* This program is free software : you can redistribute it and / or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <atomic>
+
+// Lock-free multi-producer single-consumer queue (intrusive list with a stub node, D. Vyukov)
+// push never blocks and may be called from any thread, pop may be called only from one thread
+template <typename T>
+class MpscQueue {
+	struct Node {
+		std::atomic<Node*> next;
+		T value;
+		Node() : next(nullptr) {}
+		Node(const T& value) : next(nullptr), value(value) {}
+	};
+
+	// producers append here
+	std::atomic<Node*> _head;
+	// consumer takes from here, always points to the already consumed (stub) node
+	Node* _tail;
+
+	MpscQueue(const MpscQueue&) = delete;
+	MpscQueue& operator=(const MpscQueue&) = delete;
+
+public:
+	MpscQueue() {
+		Node* stub = new Node();
+		_head.store(stub, std::memory_order_relaxed);
+		_tail = stub;
+	}
+
+	~MpscQueue() {
+		T value;
+		while (pop(value));
+		delete _tail;
+	}
+
+	// thread-safe, wait-free for the producer
+	void push(const T& value) {
+		Node* node = new Node(value);
+		Node* prev = _head.exchange(node, std::memory_order_acq_rel);
+		prev->next.store(node, std::memory_order_release);
+	}
+
+	// consumer only, returns false if the queue is empty (or the last push is not yet linked)
+	bool pop(T& value) {
+		Node* tail = _tail;
+		Node* next = tail->next.load(std::memory_order_acquire);
+		if (!next) return false;
+		value = std::move(next->value);
+		_tail = next;
+		delete tail;
+		return true;
+	}
+};
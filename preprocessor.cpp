@@ -0,0 +1,192 @@
+/*
+* BioLines (https://github.com/mmuszkow/BioLines)
+* Detection of filamentous structures in biological microscopic images
+* Copyright(C) 2017 Maciek Muszkowski
+*
+* This program is free software : you can redistribute it and / or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "stdafx.h"
+#include "preprocessor.h"
+
+const cv::Mat& Preprocessor::dilationKernel() {
+	static const cv::Mat kernel = cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(7, 7), cv::Point(3, 3));
+	return kernel;
+}
+
+void Preprocessor::threshold(const cv::Mat& src, cv::Mat& dst) {
+	if (_backend == GaussianThreshold) {
+		cv::adaptiveThreshold(src, dst, 255, cv::ADAPTIVE_THRESH_GAUSSIAN_C, cv::THRESH_BINARY, BLOCK_SIZE, C);
+		return;
+	}
+
+	// src > mean - C, the window is clipped at the borders, compared as sums to avoid division,
+	// 32-bit sums overflow above 8 Mpx of white, doubles are exact up to 2^53
+	cv::integral(src, _integral, CV_64F);
+	dst.create(src.size(), CV_8UC1);
+	const int r = BLOCK_SIZE / 2;
+	for (int y = 0; y < src.rows; y++) {
+		int y0 = std::max(0, y - r), y1 = std::min(src.rows, y + r + 1);
+		const double* top = _integral.ptr<double>(y0);
+		const double* bottom = _integral.ptr<double>(y1);
+		const uchar* in = src.ptr<uchar>(y);
+		uchar* out = dst.ptr<uchar>(y);
+		for (int x = 0; x < src.cols; x++) {
+			int x0 = std::max(0, x - r), x1 = std::min(src.cols, x + r + 1);
+			int area = (x1 - x0) * (y1 - y0);
+			double sum = bottom[x1] - bottom[x0] - top[x1] + top[x0];
+			out[x] = in[x] * area > sum - C * area ? 255 : 0;
+		}
+	}
+}
+
+const cv::Mat& Preprocessor::blurred() {
+	if (_blurred.empty()) {
+		cv::GaussianBlur(_gray, _blurred, cv::Size(0, 0), 3);
+#ifdef BIOLINES_DEBUG_DUMPS
+		if (!_debugDir.empty())
+			imwrite(_debugDir + "/ar_1_GaussianBlur.png", _blurred);
+#endif
+	}
+	return _blurred;
+}
+
+const cv::Mat& Preprocessor::blurredBin() {
+	if (_blurredBin.empty()) {
+		threshold(blurred(), _blurredBin);
+#ifdef BIOLINES_DEBUG_DUMPS
+		if (!_debugDir.empty())
+			imwrite(_debugDir + "/ar_2_adaptiveThreshold.png", _blurredBin);
+#endif
+	}
+	return _blurredBin;
+}
+
+void Preprocessor::ellipseFitOrientation(double& wagedBeanFeretAngle, double& totalArea) {
+	// dilate, concates pixel groups
+	cv::dilate(blurredBin(), _dilated, dilationKernel(), cv::Point(-1, -1), 5);
+#ifdef BIOLINES_DEBUG_DUMPS
+	if (!_debugDir.empty())
+		imwrite(_debugDir + "/ar_3_dilate.png", _dilated);
+#endif
+
+	// find pixel groups contours, findContours modifies its input so the dilated buffer is consumed here
+	std::vector<std::vector<cv::Point> > contours;
+	std::vector<cv::Vec4i> hierarchy;
+	cv::findContours(_dilated, contours, hierarchy, CV_RETR_EXTERNAL, CV_CHAIN_APPROX_SIMPLE);
+
+	// fit ellipses for big groups and check their angles
+#ifdef BIOLINES_DEBUG_DUMPS
+	cv::Mat contoursEllipses(_gray.size(), CV_8UC3, BLACK);
+#endif
+	for (std::vector<std::vector<cv::Point> >::const_iterator it = contours.begin(); it != contours.end(); it++) {
+		if (it->size() > MIN_CONTOUR_POINTS) {
+			cv::RotatedRect r = cv::fitEllipse(*it);
+			if (r.angle > 90)
+				wagedBeanFeretAngle += (r.angle - 180) * r.size.area();
+			else if (r.angle < -90)
+				wagedBeanFeretAngle += (r.angle + 180) * r.size.area();
+			else
+				wagedBeanFeretAngle += r.angle * r.size.area();
+			totalArea += r.size.area();
+#ifdef BIOLINES_DEBUG_DUMPS
+			cv::ellipse(contoursEllipses, r, cv::Vec3b(0, 0, 255), 3);
+#endif
+		}
+	}
+#ifdef BIOLINES_DEBUG_DUMPS
+	if (!_debugDir.empty())
+		imwrite(_debugDir + "/ar_5_ellipses.png", contoursEllipses);
+#endif
+}
+
+void Preprocessor::momentsOrientation(double& angleSum, double& totalArea) {
+	// same steps as for the ellipses fitting, but on downsampled image with the sizes scaled down
+	cv::Mat small, smallBlurred, smallBin;
+	cv::resize(_gray, small, cv::Size(), 1.0 / ORIENTATION_SCALE, 1.0 / ORIENTATION_SCALE, cv::INTER_AREA);
+	cv::GaussianBlur(small, smallBlurred, cv::Size(0, 0), 3.0 / ORIENTATION_SCALE);
+	cv::adaptiveThreshold(smallBlurred, smallBin, 255, cv::ADAPTIVE_THRESH_GAUSSIAN_C, cv::THRESH_BINARY,
+		(BLOCK_SIZE / ORIENTATION_SCALE) | 1, C);
+	// 5 dilations with 7x7 ellipse grow the groups by 15 pixels
+	static const cv::Mat kernel = cv::getStructuringElement(cv::MORPH_ELLIPSE,
+		cv::Size(2 * (15 / ORIENTATION_SCALE) + 1, 2 * (15 / ORIENTATION_SCALE) + 1));
+	cv::dilate(smallBin, _dilated, kernel);
+
+	// pixel groups contours, as for the ellipses fitting
+	std::vector<std::vector<cv::Point> > contours;
+	cv::findContours(_dilated, contours, CV_RETR_EXTERNAL, CV_CHAIN_APPROX_SIMPLE);
+
+	for (std::vector<std::vector<cv::Point> >::const_iterator it = contours.begin(); it != contours.end(); it++) {
+		// same big groups as for the ellipses fitting, the contours are shorter by the scale
+		if (it->size() * ORIENTATION_SCALE <= MIN_CONTOUR_POINTS) continue;
+		cv::Moments m = cv::moments(*it);
+		if (m.m00 <= 0) continue;
+		// major axis angle, y axis points down as for fitEllipse, whose angle is the minor axis one (width axis),
+		// -90 converts it, mapped to (-90, 90] as the fitEllipse angles
+		double angle = 0.5 * atan2(2 * m.mu11, m.mu20 - m.mu02) * 180.0 / M_PI - 90;
+		if (angle <= -90) angle += 180;
+		angleSum += angle * m.m00;
+		totalArea += m.m00;
+	}
+}
+
+bool Preprocessor::orientation(double& angle) {
+	if (!_hasOrientation) {
+		double angleSum = 0, totalArea = 0;
+		if (_orientationMethod == Moments)
+			momentsOrientation(angleSum, totalArea);
+		else
+			ellipseFitOrientation(angleSum, totalArea);
+		_hasOrientation = true;
+		_orientationFound = totalArea > 0;
+		_orientation = _orientationFound ? angleSum / totalArea : 0;
+	}
+	angle = _orientation;
+	return _orientationFound;
+}
+
+void Preprocessor::rotate(double angle) {
+	cv::Mat rotMat = cv::getRotationMatrix2D(cv::Point2f(_gray.cols / 2.0f, _gray.rows / 2.0f), angle, 1.0);
+	cv::Mat rotated;
+	cv::warpAffine(_gray, rotated, rotMat, _gray.size());
+	_source = rotated;
+	_bin.release();
+	_edgeMask.release();
+	_noEdges.release();
+#ifdef BIOLINES_DEBUG_DUMPS
+	if (!_debugDir.empty())
+		imwrite(_debugDir + "/ar_6_rotated.png", _source);
+#endif
+}
+
+const cv::Mat& Preprocessor::bin() {
+	if (_bin.empty())
+		threshold(_source, _bin);
+	return _bin;
+}
+
+cv::Mat& Preprocessor::edgeMask() {
+	if (_edgeMask.empty())
+		_edgeMask = cv::Mat::zeros(_source.size(), CV_8UC1);
+	return _edgeMask;
+}
+
+const cv::Mat& Preprocessor::binWithoutEdges() {
+	if (!_noEdges.empty() || _edgeMask.empty()) return _noEdges;
+
+	// thicken the edges and substract them from binarized image, no other buffers needed
+	cv::dilate(_edgeMask, _edgeMask, dilationKernel());
+	cv::subtract(bin(), _edgeMask, _noEdges);
+	return _noEdges;
+}
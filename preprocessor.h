@@ -0,0 +1,109 @@
+/*
+* BioLines (https://github.com/mmuszkow/BioLines)
+* Detection of filamentous structures in biological microscopic images
+* Copyright(C) 2017 Maciek Muszkowski
+*
+* This program is free software : you can redistribute it and / or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <string>
+
+// Preprocessing of a single image as a small graph of lazily computed nodes, each node is computed at most once
+// and shared by all the stages which need it, intermediate buffers are kept for reuse:
+//   gray -> blurred -> blurred bin -> orientation
+//   gray -> source (rotated if requested) -> bin -> bin without cell edges (edge mask drawn by the cell walls detection)
+class Preprocessor {
+public:
+	enum ThresholdBackend {
+		// cv::adaptiveThreshold, Gaussian weighted window
+		GaussianThreshold,
+		// window mean from the integral image, faster but not identical
+		BoxThreshold
+	};
+
+	enum OrientationMethod {
+		// ellipses fitted to contours of the dilated blurred bin, full resolution
+		EllipseFit,
+		// second order moments of the contours on a downsampled image, much faster
+		Moments
+	};
+
+	// adaptive threshold window size and constant
+	static const int BLOCK_SIZE = 19;
+	static const int C = -2;
+
+private:
+	ThresholdBackend _backend;
+	OrientationMethod _orientationMethod;
+	// where to dump intermediate images in debug builds, empty - no dumps
+	std::string _debugDir;
+
+	// nodes, empty until computed
+	cv::Mat _gray, _source, _blurred, _blurredBin, _bin, _edgeMask, _noEdges;
+	bool _hasOrientation, _orientationFound;
+	double _orientation;
+
+	// reused buffers
+	cv::Mat _integral, _dilated;
+
+	// downsampling factor for the moments orientation
+	static const int ORIENTATION_SCALE = 4;
+	// only big pixel groups count for the orientation, 314 = radius of 50 pixels circle, 2 * pi * r
+	static const size_t MIN_CONTOUR_POINTS = 314;
+
+	// orientation estimators, weighted angle sum and total weight
+	void ellipseFitOrientation(double& angleSum, double& totalArea);
+	void momentsOrientation(double& angleSum, double& totalArea);
+
+public:
+	Preprocessor(const cv::Mat& gray, ThresholdBackend backend,
+		OrientationMethod orientationMethod = EllipseFit, const std::string& debugDir = std::string()) :
+		_backend(backend), _orientationMethod(orientationMethod), _debugDir(debugDir), _gray(gray), _source(gray),
+		_hasOrientation(false), _orientationFound(false), _orientation(0) {}
+
+	// input image
+	inline const cv::Mat& gray() const {
+		return _gray;
+	}
+
+	// image the lines are detected on, gray or rotated gray
+	inline const cv::Mat& source() const {
+		return _source;
+	}
+
+	// gray blurred with sigma 3
+	const cv::Mat& blurred();
+	// blurred binarized
+	const cv::Mat& blurredBin();
+	// area-weighted angle of big pixel groups, same convention as cv::fitEllipse, false if there are no such groups
+	bool orientation(double& angle);
+
+	// rotates the source around the center, drops the nodes computed from it
+	void rotate(double angle);
+
+	// source binarized
+	const cv::Mat& bin();
+	// 8-bit mask of the source size, the cell walls detection draws the cell edges (class 1 and 3 lines) into it
+	cv::Mat& edgeMask();
+	// bin without the cell edges, the edge mask is dilated in place and subtracted,
+	// must be called after the edges are drawn, empty if they were not
+	const cv::Mat& binWithoutEdges();
+
+	// 8-bit adaptive threshold with the window and constant above
+	void threshold(const cv::Mat& src, cv::Mat& dst);
+	// 7x7 ellipse used for all dilations, built once
+	static const cv::Mat& dilationKernel();
+};
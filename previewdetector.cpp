@@ -0,0 +1,163 @@
+/*
+* BioLines (https://github.com/mmuszkow/BioLines)
+* Detection of filamentous structures in biological microscopic images
+* Copyright(C) 2017 Maciek Muszkowski
+*
+* This program is free software : you can redistribute it and / or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "stdafx.h"
+#include "previewdetector.h"
+#include "algorithm.h"
+#include "colorizedimage.h"
+
+PreviewDetector::PreviewDetector(QObject *parent) : QThread(parent),
+	_pendingThresholdBackend(Preprocessor::GaussianThreshold), _hasRequest(false), _quit(false), _cancel(false), _scale(1), _cropShare(1) {
+	// doesn't slow down the batch if one is running
+	start(QThread::LowPriority);
+}
+
+PreviewDetector::~PreviewDetector() {
+	{
+		QMutexLocker lock(&_mutex);
+		_quit = true;
+		_cancel = true;
+		_requested.wakeOne();
+	}
+	wait();
+}
+
+void PreviewDetector::request(const QString& image, const LinesParameters& params, int thresholdBackend) {
+	QMutexLocker lock(&_mutex);
+	_pendingImage = image;
+	_pendingParams = params;
+	_pendingThresholdBackend = thresholdBackend;
+	_hasRequest = true;
+	_cancel = true;
+	_requested.wakeOne();
+}
+
+void PreviewDetector::run() {
+	forever {
+		QString image;
+		LinesParameters params;
+		int thresholdBackend;
+		{
+			QMutexLocker lock(&_mutex);
+			while (!_hasRequest && !_quit)
+				_requested.wait(&_mutex);
+			if (_quit) return;
+			image = _pendingImage;
+			params = _pendingParams;
+			thresholdBackend = _pendingThresholdBackend;
+			_hasRequest = false;
+			// next request raises it again
+			_cancel = false;
+		}
+
+		if (image != _image && !loadCrop(image)) {
+			emit previewReady(QImage(), QString("Can't read %1").arg(QFileInfo(image).fileName()));
+			continue;
+		}
+		detect(params, thresholdBackend);
+	}
+}
+
+bool PreviewDetector::loadCrop(const QString& image) {
+	_image.clear();
+	cv::Mat gray = AlgorithmWorker::readImage(image);
+	if (gray.empty()) return false;
+
+	// center of the image, downscaled to the preview size
+	int w = std::min(gray.cols, PREVIEW_WIDTH * CROP_SCALE);
+	int h = std::min(gray.rows, PREVIEW_HEIGHT * CROP_SCALE);
+	cv::Mat crop = gray(cv::Rect((gray.cols - w) / 2, (gray.rows - h) / 2, w, h));
+	_scale = std::min(1.0, std::min(PREVIEW_WIDTH / static_cast<double>(w), PREVIEW_HEIGHT / static_cast<double>(h)));
+	cv::resize(crop, _crop, cv::Size(), _scale, _scale, cv::INTER_AREA);
+	_cropShare = w * static_cast<double>(h) / (gray.cols * static_cast<double>(gray.rows));
+	_image = image;
+	return true;
+}
+
+// candidates done and the classes shares of the overlay
+static QString statusText(long long iterations, long long total, long long accepted, const cv::Mat& all, const LinesParameters& params) {
+	long long count[3] = { 0, 0, 0 };
+	for (int y = 0; y < all.rows; y++) {
+		const cv::Vec3b* px = all.ptr<cv::Vec3b>(y);
+		for (int x = 0; x < all.cols; x++)
+			for (int cls = 0; cls < 3; cls++)
+				if (px[x] == params.color(cls)) {
+					count[cls]++;
+					break;
+				}
+	}
+	QString status = QString("%1k / %2k candidates, %3% accepted")
+		.arg(iterations / 1000)
+		.arg(total / 1000)
+		.arg(accepted * 100.0 / std::max(1LL, iterations), 0, 'f', 1);
+	double sum = static_cast<double>(count[0] + count[1] + count[2]);
+	if (sum > 0)
+		status += QString(", classes %1% / %2% / %3%")
+			.arg(count[0] * 100 / sum, 0, 'f', 1)
+			.arg(count[1] * 100 / sum, 0, 'f', 1)
+			.arg(count[2] * 100 / sum, 0, 'f', 1);
+	return status;
+}
+
+void PreviewDetector::detect(const LinesParameters& params, int thresholdBackend) {
+	// lines scaled with the crop
+	LinesParameters scaled = params;
+	scaled.line_length = std::max(2, static_cast<int>(std::lround(params.line_length * _scale)));
+	scaled.line_thickness = std::max(1, static_cast<int>(std::lround(params.line_thickness * _scale)));
+	scaled.tolerance = 0;
+
+	Preprocessor pre(_crop, static_cast<Preprocessor::ThresholdBackend>(thresholdBackend));
+	const cv::Mat& bin = pre.bin();
+	int foreground = cv::countNonZero(bin);
+	// same number of lines per crop pixel as for the whole image
+	long long total = params.sampling_density > 0 ?
+		LineDetector::budget(scaled, foreground, false) :
+		static_cast<long long>(params.iterations * _cropShare);
+	scaled.sampling_density = 0;
+
+	// the rounds are independent runs, coverage depends only on the bin, so together they draw the same as one run would
+	cv::Mat all(bin.rows, bin.cols, CV_8UC3, cv::Scalar(0, 0, 0));
+	ImageProgress progress;
+	QElapsedTimer sinceEmit;
+	sinceEmit.start();
+	for (long long done = 0; done < total;) {
+		scaled.iterations = static_cast<int>(std::min<long long>(ROUND_ITERATIONS, total - done));
+		LinesOutput round = LineDetector(scaled, _cancel, std::string(), &progress).detect(bin);
+		if (round.stats.stopReason == DetectionStats::Cancelled) return;
+		done += scaled.iterations;
+
+		// last drawn wins
+		for (int y = 0; y < all.rows; y++) {
+			const cv::Vec3b* src = round.all.ptr<cv::Vec3b>(y);
+			cv::Vec3b* dst = all.ptr<cv::Vec3b>(y);
+			for (int x = 0; x < all.cols; x++)
+				if (src[x] != BLACK) dst[x] = src[x];
+		}
+
+		// first round shows up right away, then about 10 times per second
+		if (done > ROUND_ITERATIONS && done < total && sinceEmit.elapsed() < 100) continue;
+		sinceEmit.restart();
+
+		cv::Mat overlay = ColorizedImage(_crop, all);
+		QImage img = QImage(overlay.data, overlay.cols, overlay.rows, static_cast<int>(overlay.step), QImage::Format_RGB888).rgbSwapped();
+		emit previewReady(img, statusText(progress.iterations.load(std::memory_order_relaxed), total,
+			progress.accepted.load(std::memory_order_relaxed), all, params));
+	}
+}
@@ -0,0 +1,86 @@
+/*
+* BioLines (https://github.com/mmuszkow/BioLines)
+* Detection of filamentous structures in biological microscopic images
+* Copyright(C) 2017 Maciek Muszkowski
+*
+* This program is free software : you can redistribute it and / or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef PREVIEWDETECTOR_H
+#define PREVIEWDETECTOR_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QImage>
+#include <atomic>
+#include "linedetector.h"
+#include "preprocessor.h"
+
+// Runs the main algorithm on a downscaled crop of an image in the background while the parameters are being tuned,
+// every new request cancels the running one, the overlay is published after every round of iterations
+class PreviewDetector : public QThread
+{
+	Q_OBJECT
+
+private:
+	// pending request, guarded by the mutex
+	QMutex _mutex;
+	QWaitCondition _requested;
+	QString _pendingImage;
+	LinesParameters _pendingParams;
+	int _pendingThresholdBackend;
+	bool _hasRequest, _quit;
+
+	// stops the running detection, raised by every request
+	std::atomic<bool> _cancel;
+
+	// crop of the last image, kept while only the parameters change
+	QString _image;
+	cv::Mat _crop;
+	// crop pixels per source pixel
+	double _scale;
+	// part of the image the crop covers, for scaling the iterations
+	double _cropShare;
+
+	// detection runs in rounds of this many iterations, each round is published
+	static const int ROUND_ITERATIONS = 20000;
+
+	// reads the image, crops its center and downscales it to about the preview size
+	bool loadCrop(const QString& image);
+	// runs the rounds until done or cancelled
+	void detect(const LinesParameters& params, int thresholdBackend);
+
+public:
+	// size of the preview, in pixels
+	static const int PREVIEW_WIDTH = 381, PREVIEW_HEIGHT = 341;
+	// crop is this many times bigger than the preview, then downscaled
+	static const int CROP_SCALE = 2;
+
+	PreviewDetector(QObject *parent = 0);
+	~PreviewDetector();
+
+	// cancels the running preview and starts a new one, the line length and thickness are scaled with the crop
+	void request(const QString& image, const LinesParameters& params, int thresholdBackend);
+
+signals:
+	// class overlay on the crop, and the detection counters
+	void previewReady(const QImage& overlay, const QString& status);
+
+protected:
+	void run() override;
+};
+
+#endif // PREVIEWDETECTOR_H
@@ -0,0 +1,148 @@
+/*
+* BioLines (https://github.com/mmuszkow/BioLines)
+* Detection of filamentous structures in biological microscopic images
+* Copyright(C) 2017 Maciek Muszkowski
+*
+* This program is free software : you can redistribute it and / or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "stdafx.h"
+#include "profiler.h"
+
+std::atomic<long long> Profiler::_totals[Profiler::STAGES];
+Profiler::Clock::time_point Profiler::_epoch = Profiler::Clock::now();
+
+std::mutex Profiler::_registryMutex;
+std::vector<Profiler::ThreadTrace*> Profiler::_threads;
+std::vector<std::string> Profiler::_images;
+int Profiler::_lastTid = 0;
+
+const char* Profiler::stageName(Stage stage) {
+	static const char* names[STAGES + 1] = {
+		"read",
+		"autoRotate",
+		"adaptiveThreshold",
+		"removeCellEdges",
+		"detectLines",
+		"colorize",
+		"imwrite",
+		"image"
+	};
+	return names[stage];
+}
+
+Profiler::ThreadTraceOwner::~ThreadTraceOwner() {
+	if (!trace) return;
+	std::lock_guard<std::mutex> lock(_registryMutex);
+	trace->exited = true;
+}
+
+Profiler::ThreadTrace& Profiler::threadTrace() {
+	// trace outlives the thread, so it can still be saved, it's owned by the registry
+	thread_local ThreadTraceOwner owner = { NULL };
+	if (!owner.trace) {
+		ThreadTrace* trace = new ThreadTrace();
+		trace->exited = false;
+		std::lock_guard<std::mutex> lock(_registryMutex);
+		trace->tid = ++_lastTid;
+		_threads.push_back(trace);
+		owner.trace = trace;
+	}
+	return *owner.trace;
+}
+
+void Profiler::add(Stage stage, int image, const Clock::time_point& start, const Clock::time_point& end) {
+	long long duration = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+	if (stage < STAGES)
+		_totals[stage].fetch_add(duration, std::memory_order_relaxed);
+
+	Event event = {
+		stage,
+		image,
+		std::chrono::duration_cast<std::chrono::nanoseconds>(start - _epoch).count(),
+		duration
+	};
+	ThreadTrace& trace = threadTrace();
+	if (trace.events.size() < MAX_EVENTS)
+		trace.events.push_back(event);
+}
+
+int Profiler::registerImage(const std::string& name) {
+	std::lock_guard<std::mutex> lock(_registryMutex);
+	if (_images.size() >= MAX_IMAGES) return -1;
+	_images.push_back(name);
+	return static_cast<int>(_images.size()) - 1;
+}
+
+void Profiler::reset() {
+	for (int i = 0; i < STAGES; i++)
+		_totals[i].store(0, std::memory_order_relaxed);
+
+	std::lock_guard<std::mutex> lock(_registryMutex);
+	std::vector<ThreadTrace*>::iterator it = _threads.begin();
+	while (it != _threads.end()) {
+		if ((*it)->exited) {
+			delete *it;
+			it = _threads.erase(it);
+		}
+		else {
+			// memory of a long run is given back too
+			std::vector<Event>().swap((*it)->events);
+			++it;
+		}
+	}
+	std::vector<std::string>().swap(_images);
+	_epoch = Clock::now();
+}
+
+static std::string jsonEscape(const std::string& str) {
+	std::string res;
+	for (size_t i = 0; i < str.size(); i++) {
+		char c = str[i];
+		if (c == '"' || c == '\\') res += '\\';
+		if (static_cast<unsigned char>(c) >= 0x20) res += c;
+	}
+	return res;
+}
+
+bool Profiler::saveTrace(const std::string& path) {
+	FILE* f = fopen(path.c_str(), "w");
+	if (!f) return false;
+
+	std::lock_guard<std::mutex> lock(_registryMutex);
+	fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	bool first = true;
+	for (size_t t = 0; t < _threads.size(); t++) {
+		const ThreadTrace* trace = _threads[t];
+		if (trace->events.empty()) continue;
+
+		// thread name
+		fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"worker %d\"}}",
+			first ? "" : ",\n", trace->tid, trace->tid);
+		first = false;
+
+		// complete events, microseconds
+		for (size_t e = 0; e < trace->events.size(); e++) {
+			const Event& event = trace->events[e];
+			fprintf(f, ",\n{\"name\":\"%s\",\"cat\":\"stage\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f",
+				stageName(event.stage), trace->tid, event.start / 1000.0, event.duration / 1000.0);
+			if (event.image >= 0 && event.image < static_cast<int>(_images.size()))
+				fprintf(f, ",\"args\":{\"image\":\"%s\"}", jsonEscape(_images[event.image]).c_str());
+			fprintf(f, "}");
+		}
+	}
+	fprintf(f, "\n]}\n");
+	fclose(f);
+	return true;
+}
@@ -0,0 +1,129 @@
+/*
+* BioLines (https://github.com/mmuszkow/BioLines)
+* Detection of filamentous structures in biological microscopic images
+* Copyright(C) 2017 Maciek Muszkowski
+*
+* This program is free software : you can redistribute it and / or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Time spent in each stage of the image processing: process-wide totals summed over all worker threads
+// and per-thread trace of every stage occurrence, which can be exported in Chrome trace-event format
+class Profiler {
+public:
+	enum Stage {
+		Read,
+		AutoRotate,
+		Threshold,
+		RemoveCellEdges,
+		DetectLines,
+		Colorize,
+		Write,
+		STAGES,
+		// whole image processed by a worker, traced only
+		Image = STAGES
+	};
+
+	typedef std::chrono::steady_clock Clock;
+
+	static const char* stageName(Stage stage);
+
+	// records single stage occurrence, thread-safe
+	static void add(Stage stage, int image, const Clock::time_point& start, const Clock::time_point& end);
+
+	// nanoseconds spent in the stage since last reset
+	static inline long long total(Stage stage) {
+		return _totals[stage].load(std::memory_order_relaxed);
+	}
+
+	// names the image for the trace, returns its id or -1 if there are too many, thread-safe
+	static int registerImage(const std::string& name);
+
+	// clears totals and trace, frees traces of the ended threads, must not be called when workers are running
+	static void reset();
+
+	// writes the trace collected since last reset, must not be called when workers are running
+	static bool saveTrace(const std::string& path);
+
+private:
+	struct Event {
+		Stage stage;
+		int image;
+		long long start, duration; // ns since reset
+	};
+
+	// each thread appends only to its own events, so no locking on the hot path
+	struct ThreadTrace {
+		int tid;
+		std::vector<Event> events;
+		// the thread ended, the trace is freed on next reset
+		bool exited;
+	};
+
+	// marks the trace as exited when its thread ends
+	struct ThreadTraceOwner {
+		ThreadTrace* trace;
+		~ThreadTraceOwner();
+	};
+
+	// per thread and per image names since last reset, long runs (watch mode, job server) keep only the first ones
+	static const size_t MAX_EVENTS = 100000;
+	static const size_t MAX_IMAGES = 100000;
+
+	static std::atomic<long long> _totals[STAGES];
+	static Clock::time_point _epoch;
+
+	// registered threads and images, locked only when a thread or an image is seen for the first time
+	static std::mutex _registryMutex;
+	static std::vector<ThreadTrace*> _threads;
+	static std::vector<std::string> _images;
+	static int _lastTid;
+
+	static ThreadTrace& threadTrace();
+};
+
+// Per-image time spent in each stage
+struct StageTimes {
+	long long ns[Profiler::STAGES];
+
+	StageTimes() {
+		for (int i = 0; i < Profiler::STAGES; i++)
+			ns[i] = 0;
+	}
+};
+
+// Measures the time until the end of the scope, cheap enough to stay enabled in release builds
+class ScopedStage {
+	Profiler::Stage _stage;
+	int _image;
+	StageTimes* _times;
+	Profiler::Clock::time_point _start;
+
+public:
+	ScopedStage(Profiler::Stage stage, int image = -1, StageTimes* times = NULL) :
+		_stage(stage), _image(image), _times(times), _start(Profiler::Clock::now()) {}
+	~ScopedStage() {
+		Profiler::Clock::time_point end = Profiler::Clock::now();
+		Profiler::add(_stage, _image, _start, end);
+		if (_times && _stage < Profiler::STAGES)
+			_times->ns[_stage] += std::chrono::duration_cast<std::chrono::nanoseconds>(end - _start).count();
+	}
+};
@@ -0,0 +1,39 @@
+/*
+* BioLines (https://github.com/mmuszkow/BioLines)
+* Detection of filamentous structures in biological microscopic images
+* Copyright(C) 2017 Maciek Muszkowski
+*
+* This program is free software : you can redistribute it and / or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <atomic>
+
+// Live progress of a single image, published by its worker and read by the progress sampler,
+// counters are relaxed as the sampler needs only approximate values
+struct ImageProgress {
+	// detection iterations done, summed over all detection passes
+	std::atomic<long long> iterations;
+	// candidates accepted, summed over all detection passes
+	std::atomic<long long> accepted;
+	// iterations planned by the detection passes started so far, 0 when run with a time budget
+	std::atomic<long long> budget;
+	// worker is done with the image
+	std::atomic<bool> done;
+	// some output of the image couldn't be written, set before done
+	std::atomic<bool> writeFailed;
+
+	ImageProgress() : iterations(0), accepted(0), budget(0), done(false), writeFailed(false) {}
+};
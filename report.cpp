@@ -21,38 +21,274 @@
 
 #include "report.h"
 #include <algorithm>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
 
 void Report::reinit(
 	const QString& dirPath,
-	const QString& class1, const QString& class2, const QString& class3) {
+	const QString& class1, const QString& class2, const QString& class3,
+	const QString& paramsHash, bool resume, const QString& name) {
+	// previous batch writer must be done before we touch its state
+	finish();
+
 	results.clear();
-	_filePath = QString("%1/BioLines2.txt").arg(dirPath);
+	_journaled.clear();
+	_filePath = QString("%1/%2.txt").arg(dirPath).arg(name);
+	_statsFilePath = QString("%1/%2_stats.tsv").arg(dirPath).arg(name);
 	_className[0] = class1;
 	_className[1] = class2;
 	_className[2] = class3;
+	_paramsHash = paramsHash;
+
+	// previous results are either kept or discarded
+	_journal.close();
+	_journal.setFileName(QString("%1/%2.journal").arg(dirPath).arg(name));
+	if (resume) {
+		loadJournal();
+		_journal.open(QIODevice::WriteOnly | QIODevice::Append);
+		// line torn by a crash, don't let the next result glue to it
+		if (_journal.size() > 0) {
+			QFile tail(_journal.fileName());
+			if (tail.open(QIODevice::ReadOnly) && tail.seek(tail.size() - 1) && tail.read(1) != "\n")
+				_journal.write("\n");
+		}
+	}
+	else
+		_journal.open(QIODevice::WriteOnly | QIODevice::Truncate);
+
+	// journaled results are sorted once, new ones will be merged into them
+	std::sort(results.begin(), results.end());
+	for (std::vector<Result>::iterator it = results.begin(); it != results.end(); ++it)
+		formatRow(*it);
+
+	_writer.start();
+}
+
+void Report::loadJournal() {
+	QFile journal(_journal.fileName());
+	if (!journal.open(QIODevice::ReadOnly)) return;
+
+	// position of every path in the results
+	QHash<QString, size_t> index;
+	while (!journal.atEnd()) {
+		QList<QByteArray> fields = journal.readLine().trimmed().split('\t');
+		if (fields.size() != JOURNAL_FIELDS) continue; // torn or malformed line
+		if (QString::fromLatin1(fields[0]) != _paramsHash) continue; // computed with other parameters
+
+		Result res;
+		res.durable = nullptr;
+		res.fileName = QString::fromUtf8(fields[1]);
+		res.path = QString::fromUtf8(fields[2]);
+		bool ok = true;
+		res.size = fields[3].toLongLong(&ok);
+		if (ok) res.modified = fields[4].toLongLong(&ok);
+		int field = 5;
+		for (int i = 0; i < 3 && ok; i++)
+			res.percent[i] = fields[field++].toFloat(&ok);
+		for (int i = 0; i < 3 && ok; i++)
+			res.count[i] = fields[field++].toInt(&ok);
+		if (ok) res.stats.candidates = fields[field++].toInt(&ok);
+		if (ok) res.stats.accepted = fields[field++].toInt(&ok);
+		if (ok) res.stats.coverageSum = fields[field++].toDouble(&ok);
+		if (ok) res.stats.foreground = fields[field++].toInt(&ok);
+		if (ok) {
+			int reason = fields[field++].toInt(&ok);
+			ok = ok && reason >= DetectionStats::IterationsDone && reason <= DetectionStats::Cancelled;
+			res.stats.stopReason = static_cast<DetectionStats::StopReason>(reason);
+		}
+		if (ok) res.stats.precision = fields[field++].toFloat(&ok);
+		if (ok) res.stats.budget = fields[field++].toInt(&ok);
+		for (int i = 0; i < Profiler::STAGES && ok; i++)
+			res.times.ns[i] = fields[field++].toLongLong(&ok);
+		for (int i = 0; i < 360 && ok; i++)
+			res.stats.angles[i] = fields[field++].toInt(&ok);
+		if (!ok) continue;
+
+		// in case the same image was journaled twice, last one wins
+		QHash<QString, size_t>::const_iterator found = index.constFind(res.path);
+		if (found != index.constEnd())
+			results[found.value()] = res;
+		else {
+			index.insert(res.path, results.size());
+			results.push_back(res);
+		}
+	}
+
+	// images changed since are processed again, so their old results are dropped, the kept ones are moved forward
+	size_t kept = 0;
+	for (size_t i = 0; i < results.size(); i++) {
+		const Result& res = results[i];
+		QFileInfo source(res.path);
+		if (source.exists() && (source.size() != res.size || source.lastModified().toMSecsSinceEpoch() != res.modified))
+			continue;
+		_journaled.insert(sourceKey(res.path, res.size, res.modified));
+		if (kept != i)
+			results[kept] = res;
+		kept++;
+	}
+	results.resize(kept);
+}
+
+QByteArray Report::journalLine(const Result& res) const {
+	QByteArray line = _paramsHash.toLatin1();
+	line += '\t';
+	line += res.fileName.toUtf8();
+	line += '\t';
+	line += res.path.toUtf8();
+	line += '\t';
+	line += QByteArray::number(res.size);
+	line += '\t';
+	line += QByteArray::number(res.modified);
+	for (int i = 0; i < 3; i++) {
+		line += '\t';
+		line += QByteArray::number(res.percent[i], 'g', 9);
+	}
+	for (int i = 0; i < 3; i++) {
+		line += '\t';
+		line += QByteArray::number(res.count[i]);
+	}
+	line += '\t';
+	line += QByteArray::number(res.stats.candidates);
+	line += '\t';
+	line += QByteArray::number(res.stats.accepted);
+	line += '\t';
+	line += QByteArray::number(res.stats.coverageSum, 'g', 17);
+	line += '\t';
+	line += QByteArray::number(res.stats.foreground);
+	line += '\t';
+	line += QByteArray::number(res.stats.stopReason);
+	line += '\t';
+	line += QByteArray::number(res.stats.precision, 'g', 9);
+	line += '\t';
+	line += QByteArray::number(res.stats.budget);
+	for (int i = 0; i < Profiler::STAGES; i++) {
+		line += '\t';
+		line += QByteArray::number(res.times.ns[i]);
+	}
+	for (int i = 0; i < 360; i++) {
+		line += '\t';
+		line += QByteArray::number(res.stats.angles[i]);
+	}
+	line += '\n';
+	return line;
+}
+
+void Report::formatRow(Result& res) const {
+	QLocale locale = QLocale::system();
+	res.row = QString("%1\t%2\t%3\t%4")
+		.arg(res.fileName)
+		.arg(locale.toString(res.percent[0]))
+		.arg(locale.toString(res.percent[1]))
+		.arg(locale.toString(res.percent[2]));
+}
+
+void Report::writeLoop() {
+	for (;;) {
+		bool finishing;
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_wake.wait(lock, [this]() { return _queued || _finishing; });
+			_queued = false;
+			// read the flag before draining, so nothing pushed before finish() is missed
+			finishing = _finishing;
+		}
+		if (!drainQueue() && finishing) return;
+	}
+}
+
+bool Report::drainQueue() {
+	std::vector<Result> batch;
+	Result res;
+	while (_queue.pop(res))
+		batch.push_back(res);
+	if (batch.empty()) return false;
+
+	// journal whole batch at once, single flush to disk
+	if (_journal.isOpen()) {
+		QByteArray lines;
+		for (std::vector<Result>::const_iterator it = batch.begin(); it != batch.end(); ++it)
+			lines += journalLine(*it);
+		_journal.write(lines);
+
+		// make it durable, a crash right after this point must not lose the results
+		_journal.flush();
+#ifdef _WIN32
+		_commit(_journal.handle());
+#else
+		fsync(_journal.handle());
+#endif
+	}
+
+	// producers may return now
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		for (std::vector<Result>::iterator it = batch.begin(); it != batch.end(); ++it)
+			if (it->durable) {
+				it->durable->store(true, std::memory_order_relaxed);
+				it->durable = nullptr;
+			}
+	}
+	_synced.notify_all();
+
+	// batch is small, sort it and merge with already sorted results
+	for (std::vector<Result>::iterator it = batch.begin(); it != batch.end(); ++it)
+		formatRow(*it);
+	std::sort(batch.begin(), batch.end());
+	size_t sorted = results.size();
+	results.insert(results.end(), batch.begin(), batch.end());
+	std::inplace_merge(results.begin(), results.begin() + sorted, results.end());
+	return true;
 }
 
-// thread-safe
-void Report::addResult(const QString& fileName, int color1count, int color2count, int color3count) {
+void Report::finish() {
+	if (!_writer.isRunning()) return;
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_finishing = true;
+	}
+	_wake.notify_one();
+	_writer.wait();
+	_finishing = false;
+}
+
+// thread-safe, the queue is lock-free, the lock is only for waking up the writer and waiting for the sync
+void Report::addResult(const QFileInfo& source, int color1count, int color2count, int color3count, const DetectionStats& stats, const StageTimes& times) {
 	float totalCount = color1count + color2count + color3count;
-	_mutex.lock();
+	Result res;
+	res.fileName = source.fileName();
+	res.path = source.absoluteFilePath();
+	res.size = source.size();
+	res.modified = source.lastModified().toMSecsSinceEpoch();
+	res.count[0] = color1count;
+	res.count[1] = color2count;
+	res.count[2] = color3count;
+	res.stats = stats;
+	res.times = times;
+	for (int i = 0; i < 3; i++)
+		res.percent[i] = 0.0f;
 	if (totalCount > 0) {
-		Result res = {
-			fileName,
-			((color1count*100.0f) / totalCount),
-			((color2count*100.0f) / totalCount),
-			((color3count*100.0f) / totalCount)
-		};
-		results.push_back(res);
+		res.percent[0] = (color1count*100.0f) / totalCount;
+		res.percent[1] = (color2count*100.0f) / totalCount;
+		res.percent[2] = (color3count*100.0f) / totalCount;
 	}
-	else {
-		Result res = { fileName, 0.0f, 0.0f, 0.0f };
-		results.push_back(res);
-	}
-	_mutex.unlock();
+
+	// the result is reported as done by the caller, so it must survive a crash by then
+	std::atomic<bool> durable(false);
+	res.durable = &durable;
+	_queue.push(res);
+	std::unique_lock<std::mutex> lock(_mutex);
+	_queued = true;
+	_wake.notify_one();
+	_synced.wait(lock, [&durable]() { return durable.load(std::memory_order_relaxed); });
 }
 
 void Report::saveToDisk() {
+	// all the results must be merged first
+	finish();
+
 	if (_filePath.isEmpty()) return;
 
 	// open file
@@ -66,19 +302,58 @@ void Report::saveToDisk() {
 		_className[1] << "\t" <<
 		_className[2] << endl;
 
-	// sort results by filename
-	std::sort(results.begin(), results.end());
-
-	// write results to file
+	// results are already sorted and formatted by the writer
 	std::vector<Result>::const_iterator it = results.begin(), end = results.end();
-	QLocale& locale = QLocale::system();
 	while (it != end) {
-		reportStream << 
-			it->fileName << "\t" << 
-			locale.toString(it->percent[0]) << "\t" <<
-			locale.toString(it->percent[1]) << "\t" <<
-			locale.toString(it->percent[2]) << endl;
+		reportStream << it->row << endl;
 		++it;
 	}
 	reportStream.flush();
+
+	saveStatsToDisk();
+}
+
+void Report::checkpoint() {
+	saveToDisk();
+	_writer.start();
+}
+
+void Report::saveStatsToDisk() {
+	QFile stats(_statsFilePath);
+	if (!stats.open(QIODevice::WriteOnly)) return;
+
+	// machine-readable, so no locale formatting here
+	QByteArray header("Image\tClass1Pixels\tClass2Pixels\tClass3Pixels\tCandidates\tAccepted\tRejected\tMeanCoverage\tForeground\tStopReason\tPrecision\tBudget");
+	for (int i = 0; i < Profiler::STAGES; i++)
+		header += '\t' + QByteArray(Profiler::stageName((Profiler::Stage)i)) + "Ms";
+	for (int i = 0; i < 360; i++)
+		header += "\tAngle" + QByteArray::number(i);
+	header += '\n';
+	stats.write(header);
+
+	std::vector<Result>::const_iterator it = results.begin(), end = results.end();
+	while (it != end) {
+		QByteArray line = it->fileName.toUtf8();
+		for (int i = 0; i < 3; i++)
+			line += '\t' + QByteArray::number(it->count[i]);
+		line += '\t' + QByteArray::number(it->stats.candidates);
+		line += '\t' + QByteArray::number(it->stats.accepted);
+		line += '\t' + QByteArray::number(it->stats.rejected());
+		line += '\t' + QByteArray::number(it->stats.meanCoverage(), 'g', 6);
+		line += '\t' + QByteArray::number(it->stats.foreground);
+		line += '\t' + QByteArray(DetectionStats::stopReasonName(it->stats.stopReason));
+		line += '\t';
+		if (it->stats.precision >= 0)
+			line += QByteArray::number(it->stats.precision, 'f', 2);
+		line += '\t';
+		if (it->stats.budget >= 0)
+			line += QByteArray::number(it->stats.budget);
+		for (int i = 0; i < Profiler::STAGES; i++)
+			line += '\t' + QByteArray::number(it->times.ns[i] / 1e6, 'f', 3);
+		for (int i = 0; i < 360; i++)
+			line += '\t' + QByteArray::number(it->stats.angles[i]);
+		line += '\n';
+		stats.write(line);
+		++it;
+	}
 }
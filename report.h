@@ -20,41 +20,122 @@
 #pragma once
 
 #include <vector>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include "mpscqueue.h"
+#include "linedetector.h"
+#include "profiler.h"
 
 // Text report on how many % each class occupies, thread-safe
+// every result is also appended to a journal file as soon as it arrives, so an interrupted batch can be resumed
+// workers push results into a lock-free queue, formatting, journaling and ordering is done by a writer thread,
+// addResult returns once the result is synced to the journal, all results queued meanwhile share one sync
 class Report {
 
 	struct Result {
 		QString fileName;
+		// identity of the source image for resume, absolute path, size and modification time in ms
+		QString path;
+		qint64 size, modified;
 		float percent[3];
+		int count[3];
+		DetectionStats stats;
+		// time spent in each processing stage
+		StageTimes times;
+		// formatted report line, filled by the writer thread
+		QString row;
+		// set by the writer once the result is in the journal, null when nobody waits for it
+		std::atomic<bool>* durable;
 
 		// for sorting
 		inline bool operator<(const Result& other) const {
-			return fileName < other.fileName;
+			return fileName < other.fileName || (fileName == other.fileName && path < other.path);
 		}
 	};
 
-	QString _filePath;
+	// drains the queue until the report is finished
+	class Writer : public QThread {
+		Report& _report;
+	public:
+		Writer(Report& report) : _report(report) {}
+	protected:
+		void run() override { _report.writeLoop(); }
+	};
+
+	QString _filePath, _statsFilePath;
 	QString _className[3];
-	QMutex _mutex;
+
+	// results journal, one line per result: parameters hash, file name, path, size, modification time,
+	// 3 percents, 3 pixel counts, stats, stage times
+	QFile _journal;
+	QString _paramsHash;
+	// keys of the journaled source images
+	QSet<QString> _journaled;
+
+	// results not yet handled by the writer
+	MpscQueue<Result> _queue;
+	Writer _writer;
+	// wakes up the writer when something was queued or it should finish, and the producers when it's durable
+	std::mutex _mutex;
+	std::condition_variable _wake, _synced;
+	bool _queued, _finishing;
+
+	// reads results with matching parameters hash from the journal
+	void loadJournal();
+	// number of tab-separated fields in a journal line
+	static const int JOURNAL_FIELDS = 5 + 3 + 3 + 7 + Profiler::STAGES + 360;
+	// same image means same path, size and modification time
+	static inline QString sourceKey(const QString& path, qint64 size, qint64 modified) {
+		return QString("%1|%2|%3").arg(path).arg(size).arg(modified);
+	}
+	// journal line for single result
+	QByteArray journalLine(const Result& res) const;
+	// formats the report line
+	void formatRow(Result& res) const;
+	// writes the detection statistics file
+	void saveStatsToDisk();
+	// writer thread main loop
+	void writeLoop();
+	// takes everything from the queue, journals it and merges it into sorted results, false if there was nothing
+	bool drainQueue();
+	// stops the writer after it handles all queued results
+	void finish();
+
 public:
+	// sorted by filename, owned by the writer thread until saveToDisk
 	std::vector<Result> results;
 
-	Report() {}
+	Report() : _writer(*this), _queued(false), _finishing(false) {}
 	Report(
 		const QString& dirPath,
-		const QString& class1, const QString& class2, const QString& class3) {
-		reinit(dirPath, class1, class2, class3);
+		const QString& class1, const QString& class2, const QString& class3,
+		const QString& paramsHash, bool resume, const QString& name = "BioLines2") : Report() {
+		reinit(dirPath, class1, class2, class3, paramsHash, resume, name);
+	}
+	~Report() {
+		finish();
+		_journal.close();
 	}
 
-	// constructor
+	// constructor, if resume is set the results from the previous journal with the same parameters hash are kept,
+	// name of the report, stats and journal files without the extension
 	void reinit(
 		const QString& dirPath,
-		const QString& class1, const QString& class2, const QString& class3);
+		const QString& class1, const QString& class2, const QString& class3,
+		const QString& paramsHash, bool resume, const QString& name = "BioLines2");
+
+	// true if this image, unchanged since, was already processed with the same parameters (resume)
+	inline bool isJournaled(const QFileInfo& source) const {
+		return _journaled.contains(sourceKey(source.absoluteFilePath(), source.size(), source.lastModified().toMSecsSinceEpoch()));
+	}
 
-	// adds a single result to the list, thread-safe
-	void addResult(const QString& fileName, int color1count, int color2count, int color3count);
+	// adds a single result to the writer queue and waits until it's durable, thread-safe
+	void addResult(const QFileInfo& source, int color1count, int color2count, int color3count, const DetectionStats& stats, const StageTimes& times);
 
-	// saves .txt file with sorted results to disk
+	// waits for the writer and saves .txt file with sorted results to disk,
+	// detection statistics and angles histogram go to a separate tab-separated file
 	void saveToDisk();
+	// saveToDisk while new results can still be added, for the watch mode
+	void checkpoint();
 };
@@ -0,0 +1,82 @@
+/*
+* BioLines (https://github.com/mmuszkow/BioLines)
+* Detection of filamentous structures in biological microscopic images
+* Copyright(C) 2017 Maciek Muszkowski
+*
+* This program is free software : you can redistribute it and / or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "stdafx.h"
+#include "segmentfile.h"
+
+bool SegmentFile::write(const std::string& fn, Format format, const std::vector<Segment>& segments, int width, int height, int thickness) {
+	if (!fits(format, width, height)) return false;
+	FILE* f;
+	fopen_s(&f, fn.c_str(), format == Csv ? "w" : "wb");
+	if (!f) return false;
+	bool ok = format == Csv ? writeCsv(f, segments) : writeBinary(f, segments, width, height, thickness);
+	return fclose(f) == 0 && ok;
+}
+
+bool SegmentFile::writeCsv(FILE* f, const std::vector<Segment>& segments) {
+	fprintf(f, "x1,y1,x2,y2,angle,class,coverage\n");
+	for (std::vector<Segment>::const_iterator it = segments.begin(); it != segments.end(); ++it)
+		fprintf(f, "%d,%d,%d,%d,%.2f,%d,%.4f\n", it->x1, it->y1, it->x2, it->y2, it->angle, it->cls + 1, it->coverage);
+	return ferror(f) == 0;
+}
+
+bool SegmentFile::writeBinary(FILE* f, const std::vector<Segment>& segments, int width, int height, int thickness) {
+	Header header = { { 'B', 'L', 'S', 'G' }, VERSION, static_cast<uint16_t>(thickness),
+		static_cast<uint32_t>(width), static_cast<uint32_t>(height), static_cast<uint32_t>(segments.size()) };
+	fwrite(&header, sizeof(header), 1, f);
+
+	std::vector<Record> records(segments.size());
+	for (size_t i = 0; i < segments.size(); i++) {
+		const Segment& s = segments[i];
+		Record r = { static_cast<uint16_t>(s.x1), static_cast<uint16_t>(s.y1), static_cast<uint16_t>(s.x2), static_cast<uint16_t>(s.y2),
+			static_cast<uint16_t>(s.angle * 100 + 0.5f), static_cast<uint8_t>(s.cls + 1), 0, s.coverage };
+		records[i] = r;
+	}
+	if (!records.empty())
+		fwrite(records.data(), sizeof(Record), records.size(), f);
+	return ferror(f) == 0;
+}
+
+bool SegmentFile::read(const std::string& fn, std::vector<Segment>& segments, int& width, int& height, int& thickness) {
+	FILE* f;
+	fopen_s(&f, fn.c_str(), "rb");
+	if (!f) return false;
+
+	Header header;
+	if (fread(&header, sizeof(header), 1, f) != 1 || memcmp(header.magic, "BLSG", 4) != 0 || header.version != VERSION) {
+		fclose(f);
+		return false;
+	}
+	std::vector<Record> records(header.count);
+	size_t read = records.empty() ? 0 : fread(records.data(), sizeof(Record), records.size(), f);
+	fclose(f);
+	if (read != records.size()) return false;
+
+	width = header.width;
+	height = header.height;
+	thickness = header.thickness;
+	segments.resize(records.size());
+	for (size_t i = 0; i < records.size(); i++) {
+		const Record& r = records[i];
+		Segment s = { r.x1, r.y1, r.x2, r.y2, r.angle / 100.0f, r.cls - 1, r.coverage };
+		segments[i] = s;
+	}
+	return true;
+}
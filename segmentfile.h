@@ -0,0 +1,77 @@
+/*
+* BioLines (https://github.com/mmuszkow/BioLines)
+* Detection of filamentous structures in biological microscopic images
+* Copyright(C) 2017 Maciek Muszkowski
+*
+* This program is free software : you can redistribute it and / or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include "linedetector.h"
+
+// Accepted lines of an image as a list of segments, kilobytes instead of the raster masks,
+// coordinates are in the processed image (after auto-rotation if the image was rotated)
+//
+// csv: header line, then x1,y1,x2,y2,angle,class,coverage per line, class is 1-3
+// binary, little-endian:
+//   header (20 bytes): "BLSG", uint16 version, uint16 line thickness, uint32 image width, uint32 image height, uint32 lines count
+//   line (16 bytes): uint16 x1, y1, x2, y2, uint16 angle in 1/100 degree, uint8 class (1-3), uint8 reserved, float coverage
+//   images wider or taller than 65535 px are not written, use csv for them
+class SegmentFile {
+public:
+	enum Format {
+		Csv = 1,
+		Binary = 2
+	};
+
+	static const uint16_t VERSION = 1;
+
+	static inline const char* extension(Format format) {
+		return format == Csv ? "csv" : "bin";
+	}
+
+	// coordinates of the binary format are 16-bit
+	static const int MAX_BINARY_SIZE = 65535;
+
+	static inline bool fits(Format format, int width, int height) {
+		return format == Csv || (width <= MAX_BINARY_SIZE && height <= MAX_BINARY_SIZE);
+	}
+
+	// false if the file can't be written or the image doesn't fit the format, nothing is written then
+	static bool write(const std::string& fn, Format format, const std::vector<Segment>& segments, int width, int height, int thickness);
+
+	// reads the binary format back
+	static bool read(const std::string& fn, std::vector<Segment>& segments, int& width, int& height, int& thickness);
+
+private:
+	static bool writeCsv(FILE* f, const std::vector<Segment>& segments);
+	static bool writeBinary(FILE* f, const std::vector<Segment>& segments, int width, int height, int thickness);
+
+#pragma pack(push, 1)
+	struct Header {
+		char magic[4];
+		uint16_t version, thickness;
+		uint32_t width, height, count;
+	};
+	struct Record {
+		uint16_t x1, y1, x2, y2, angle;
+		uint8_t cls, reserved;
+		float coverage;
+	};
+#pragma pack(pop)
+};
@@ -0,0 +1,69 @@
+/*
+* BioLines (https://github.com/mmuszkow/BioLines)
+* Detection of filamentous structures in biological microscopic images
+* Copyright(C) 2017 Maciek Muszkowski
+*
+* This program is free software : you can redistribute it and / or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "stdafx.h"
+#include "thumbnailloader.h"
+#include "algorithm.h"
+
+ThumbnailLoader::ThumbnailLoader(QObject *parent) : QThread(parent), _quit(false) {
+	start(QThread::LowPriority);
+}
+
+ThumbnailLoader::~ThumbnailLoader() {
+	{
+		QMutexLocker lock(&_mutex);
+		_quit = true;
+		_requested.wakeOne();
+	}
+	wait();
+}
+
+void ThumbnailLoader::request(const QString& fn) {
+	QMutexLocker lock(&_mutex);
+	_pending.removeOne(fn);
+	_pending.append(fn);
+	if (_pending.size() > MAX_PENDING)
+		_pending.removeFirst();
+	_requested.wakeOne();
+}
+
+void ThumbnailLoader::clear() {
+	QMutexLocker lock(&_mutex);
+	_pending.clear();
+}
+
+void ThumbnailLoader::run() {
+	forever {
+		QString fn;
+		{
+			QMutexLocker lock(&_mutex);
+			while (_pending.isEmpty() && !_quit)
+				_requested.wait(&_mutex);
+			if (_quit) return;
+			fn = _pending.takeLast();
+		}
+
+		cv::Mat gray = AlgorithmWorker::readThumbnail(fn, THUMBNAIL_SIZE);
+		QImage thumbnail;
+		if (!gray.empty())
+			thumbnail = QImage(gray.data, gray.cols, gray.rows, static_cast<int>(gray.step), QImage::Format_Grayscale8).copy();
+		emit thumbnailReady(fn, thumbnail);
+	}
+}
@@ -0,0 +1,66 @@
+/*
+* BioLines (https://github.com/mmuszkow/BioLines)
+* Detection of filamentous structures in biological microscopic images
+* Copyright(C) 2017 Maciek Muszkowski
+*
+* This program is free software : you can redistribute it and / or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef THUMBNAILLOADER_H
+#define THUMBNAILLOADER_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QImage>
+#include <QStringList>
+
+// Decodes the thumbnails of the image list in the background, the last requested one goes first,
+// so the images scrolled into view show up before the ones scrolled past
+class ThumbnailLoader : public QThread
+{
+	Q_OBJECT
+
+private:
+	// pending requests, guarded by the mutex
+	QMutex _mutex;
+	QWaitCondition _requested;
+	QStringList _pending;
+	bool _quit;
+
+	// older requests are dropped when scrolling fast through a long list
+	static const int MAX_PENDING = 256;
+
+public:
+	// thumbnails fit in a square of this size, in pixels
+	static const int THUMBNAIL_SIZE = 64;
+
+	ThumbnailLoader(QObject *parent = 0);
+	~ThumbnailLoader();
+
+	// queues the file, thumbnailReady is emitted when it's decoded
+	void request(const QString& fn);
+	// drops all pending requests
+	void clear();
+
+signals:
+	// null image if the file can't be read
+	void thumbnailReady(const QString& fn, const QImage& thumbnail);
+
+protected:
+	void run() override;
+};
+
+#endif // THUMBNAILLOADER_H
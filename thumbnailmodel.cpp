@@ -0,0 +1,72 @@
+/*
+* BioLines (https://github.com/mmuszkow/BioLines)
+* Detection of filamentous structures in biological microscopic images
+* Copyright(C) 2017 Maciek Muszkowski
+*
+* This program is free software : you can redistribute it and / or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "stdafx.h"
+#include "thumbnailmodel.h"
+
+ThumbnailModel::ThumbnailModel(QObject *parent) : QAbstractListModel(parent), _cache(CACHE_SIZE_KB) {
+	connect(&_loader, &ThumbnailLoader::thumbnailReady, this, &ThumbnailModel::onThumbnailReady);
+}
+
+void ThumbnailModel::setFiles(const QStringList& files) {
+	beginResetModel();
+	_loader.clear();
+	_files = files;
+	_rows.clear();
+	for (int row = 0; row < _files.size(); row++)
+		_rows.insert(_files[row], row);
+	endResetModel();
+}
+
+int ThumbnailModel::rowCount(const QModelIndex& parent) const {
+	return parent.isValid() ? 0 : _files.size();
+}
+
+QVariant ThumbnailModel::data(const QModelIndex& index, int role) const {
+	if (!index.isValid() || index.row() >= _files.size())
+		return QVariant();
+
+	const QString& fn = _files[index.row()];
+	switch (role) {
+	case Qt::DisplayRole:
+		return QFileInfo(fn).fileName();
+	case Qt::ToolTipRole:
+		return fn;
+	case Qt::DecorationRole:
+		if (QImage* thumbnail = _cache.object(fn))
+			return thumbnail->isNull() ? QVariant() : QVariant(*thumbnail);
+		// asked again on every repaint, which moves the visible ones to the front of the queue
+		_loader.request(fn);
+		return QVariant();
+	default:
+		return QVariant();
+	}
+}
+
+void ThumbnailModel::onThumbnailReady(const QString& fn, const QImage& thumbnail) {
+	// unreadable files are cached too, so they're not decoded again
+	_cache.insert(fn, new QImage(thumbnail), std::max(1, thumbnail.byteCount() / 1024));
+
+	QHash<QString, int>::ConstIterator row = _rows.find(fn);
+	if (row != _rows.end()) {
+		QModelIndex idx = index(row.value());
+		emit dataChanged(idx, idx, QVector<int>() << Qt::DecorationRole);
+	}
+}
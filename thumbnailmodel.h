@@ -0,0 +1,58 @@
+/*
+* BioLines (https://github.com/mmuszkow/BioLines)
+* Detection of filamentous structures in biological microscopic images
+* Copyright(C) 2017 Maciek Muszkowski
+*
+* This program is free software : you can redistribute it and / or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef THUMBNAILMODEL_H
+#define THUMBNAILMODEL_H
+
+#include <QAbstractListModel>
+#include <QCache>
+#include <QHash>
+#include "thumbnailloader.h"
+
+// Selected images with their thumbnails, the view asks only for the visible rows, so thumbnails
+// are requested lazily and kept in a LRU cache, which survives selecting the same images again
+class ThumbnailModel : public QAbstractListModel
+{
+	Q_OBJECT
+
+private:
+	QStringList _files;
+	// row of every file, for updating it when its thumbnail arrives
+	QHash<QString, int> _rows;
+	// thumbnails, cost in kB
+	mutable QCache<QString, QImage> _cache;
+	mutable ThumbnailLoader _loader;
+
+	// about 8k grayscale thumbnails
+	static const int CACHE_SIZE_KB = 32 * 1024;
+
+public:
+	ThumbnailModel(QObject *parent = 0);
+
+	void setFiles(const QStringList& files);
+
+	int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+	QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+
+private slots:
+	void onThumbnailReady(const QString& fn, const QImage& thumbnail);
+};
+
+#endif // THUMBNAILMODEL_H
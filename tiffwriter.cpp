@@ -0,0 +1,230 @@
+/*
+* BioLines (https://github.com/mmuszkow/BioLines)
+* Detection of filamentous structures in biological microscopic images
+* Copyright(C) 2017 Maciek Muszkowski
+*
+* This program is free software : you can redistribute it and / or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "stdafx.h"
+#include "tiffwriter.h"
+#include "lzw.h"
+#include "mpscqueue.h"
+#include <thread>
+
+// field types
+static const uint16_t TIFF_SHORT = 3, TIFF_LONG = 4, TIFF_ASCII = 2;
+
+TiffWriter::TiffWriter(const std::string& fn, Compression compression, int threads) : _file(NULL), _compression(compression), _threads(std::max(1, threads)), _nextIfdPos(4) {
+	fopen_s(&_file, fn.c_str(), "wb");
+	if (!_file) return;
+
+	// little-endian header, offset of the first IFD is written with the first page
+	const uint8_t header[8] = { 'I', 'I', 42, 0, 0, 0, 0, 0 };
+	fwrite(header, 1, sizeof(header), _file);
+}
+
+TiffWriter::~TiffWriter() {
+	if (_file) fclose(_file);
+}
+
+uint32_t TiffWriter::append(const void* data, size_t size) {
+	fseek(_file, 0, SEEK_END);
+	long pos = ftell(_file);
+	if (pos & 1) {
+		fputc(0, _file);
+		pos++;
+	}
+	fwrite(data, 1, size, _file);
+	return static_cast<uint32_t>(pos);
+}
+
+void TiffWriter::packBits(const uint8_t* row, int len, std::vector<uint8_t>& out) {
+	int i = 0;
+	while (i < len) {
+		// run of at least 2 same bytes, up to 128
+		int run = 1;
+		while (i + run < len && run < 128 && row[i + run] == row[i]) run++;
+		if (run > 1) {
+			out.push_back(static_cast<uint8_t>(1 - run));
+			out.push_back(row[i]);
+			i += run;
+			continue;
+		}
+
+		// literals until the next run, up to 128
+		int lit = 1;
+		while (i + lit < len && lit < 128 && (i + lit + 1 >= len || row[i + lit] != row[i + lit + 1])) lit++;
+		out.push_back(static_cast<uint8_t>(lit - 1));
+		out.insert(out.end(), row + i, row + i + lit);
+		i += lit;
+	}
+}
+
+void TiffWriter::horizontalPredictor(uint8_t* row, int len, int channels) {
+	for (int x = len - 1; x >= channels; x--)
+		row[x] -= row[x - channels];
+}
+
+std::vector<uint8_t> TiffWriter::encodeStrip(const cv::Mat& img, int strip) const {
+	int channels = img.channels();
+	int rowBytes = img.cols * channels;
+	int y0 = strip * ROWS_PER_STRIP;
+	int rows = std::min(ROWS_PER_STRIP, img.rows - y0);
+
+	// RGB order in the file
+	std::vector<uint8_t> raw(static_cast<size_t>(rows) * rowBytes);
+	for (int y = 0; y < rows; y++) {
+		const uint8_t* src = img.ptr<uint8_t>(y0 + y);
+		uint8_t* dst = &raw[static_cast<size_t>(y) * rowBytes];
+		if (channels == 1)
+			memcpy(dst, src, rowBytes);
+		else
+			for (int x = 0; x < rowBytes; x += 3) {
+				dst[x] = src[x + 2];
+				dst[x + 1] = src[x + 1];
+				dst[x + 2] = src[x];
+			}
+		if (_compression == Lzw)
+			horizontalPredictor(dst, rowBytes, channels);
+	}
+	return compress(raw.data(), rows, rowBytes);
+}
+
+std::vector<uint8_t> TiffWriter::compress(const uint8_t* strip, int rows, int rowBytes) const {
+	size_t size = static_cast<size_t>(rows) * rowBytes;
+	std::vector<uint8_t> out;
+	switch (_compression) {
+	case PackBits:
+		// rows are packed separately
+		out.reserve(size / 4);
+		for (int y = 0; y < rows; y++)
+			packBits(strip + static_cast<size_t>(y) * rowBytes, rowBytes, out);
+		break;
+	case Lzw: {
+		struct lzw_buff* enc = lzw_encode_tiff(strip, size);
+		const uint8_t* data = (const uint8_t*) &enc->data;
+		out.assign(data, data + enc->length);
+		free(enc);
+		break;
+	}
+	default:
+		out.assign(strip, strip + size);
+	}
+	return out;
+}
+
+bool TiffWriter::addPage(const cv::Mat& img, const std::string& description) {
+	if (!_file) return false;
+	if (img.type() != CV_8UC1 && img.type() != CV_8UC3) return false;
+
+	int channels = img.channels();
+	int strips = (img.rows + ROWS_PER_STRIP - 1) / ROWS_PER_STRIP;
+	std::vector<uint32_t> offsets(strips), counts(strips);
+
+	// strips are compressed by the helper threads and the caller, each one is written as soon as it's done,
+	// so the file is written while the rest is still being compressed
+	std::atomic<int> nextStrip(0);
+	MpscQueue<EncodedStrip> done;
+	auto encodeStrips = [&]() {
+		for (int s; (s = nextStrip.fetch_add(1)) < strips;) {
+			EncodedStrip encoded = { s, new std::vector<uint8_t>(encodeStrip(img, s)) };
+			done.push(encoded);
+		}
+	};
+	std::vector<std::thread> helpers;
+	for (int i = 1; i < std::min(_threads, strips); i++)
+		helpers.push_back(std::thread(encodeStrips));
+
+	for (int written = 0; written < strips;) {
+		EncodedStrip encoded;
+		int s;
+		if (done.pop(encoded)) {
+			offsets[encoded.index] = append(encoded.data->data(), encoded.data->size());
+			counts[encoded.index] = static_cast<uint32_t>(encoded.data->size());
+			delete encoded.data;
+			written++;
+		} else if ((s = nextStrip.fetch_add(1)) < strips) {
+			std::vector<uint8_t> data = encodeStrip(img, s);
+			offsets[s] = append(data.data(), data.size());
+			counts[s] = static_cast<uint32_t>(data.size());
+			written++;
+		} else
+			std::this_thread::yield();
+	}
+	for (size_t i = 0; i < helpers.size(); i++)
+		helpers[i].join();
+
+	// values which don't fit into the entries, values are little-endian as the header says, same as the host
+	const uint16_t bitsPerSample[3] = { 8, 8, 8 };
+	uint32_t bitsPerSampleValue = channels == 1 ? 8 : append(bitsPerSample, sizeof(bitsPerSample));
+	uint32_t descriptionValue = 0;
+	if (description.size() < 4)
+		memcpy(&descriptionValue, description.c_str(), description.size() + 1);
+	else
+		descriptionValue = append(description.c_str(), description.size() + 1);
+	uint32_t offsetsValue = strips == 1 ? offsets[0] : append(offsets.data(), offsets.size() * 4);
+	uint32_t countsValue = strips == 1 ? counts[0] : append(counts.data(), counts.size() * 4);
+
+	// IFD entries, sorted by tag
+	std::vector<Entry> entries;
+	Entry subfileType = { 254, TIFF_LONG, 1, 2 }; // page of a multi-page file
+	Entry width = { 256, TIFF_LONG, 1, static_cast<uint32_t>(img.cols) };
+	Entry height = { 257, TIFF_LONG, 1, static_cast<uint32_t>(img.rows) };
+	Entry bits = { 258, TIFF_SHORT, static_cast<uint32_t>(channels), bitsPerSampleValue };
+	Entry compression = { 259, TIFF_SHORT, 1, static_cast<uint32_t>(_compression) };
+	Entry photometric = { 262, TIFF_SHORT, 1, channels == 1 ? 1u : 2u }; // BlackIsZero or RGB
+	Entry imageDescription = { 270, TIFF_ASCII, static_cast<uint32_t>(description.size() + 1), descriptionValue };
+	Entry stripOffsets = { 273, TIFF_LONG, static_cast<uint32_t>(strips), offsetsValue };
+	Entry samplesPerPixel = { 277, TIFF_SHORT, 1, static_cast<uint32_t>(channels) };
+	Entry rowsPerStrip = { 278, TIFF_LONG, 1, static_cast<uint32_t>(ROWS_PER_STRIP) };
+	Entry stripByteCounts = { 279, TIFF_LONG, static_cast<uint32_t>(strips), countsValue };
+	Entry planarConfig = { 284, TIFF_SHORT, 1, 1 }; // chunky
+	Entry predictor = { 317, TIFF_SHORT, 1, 2 }; // horizontal differencing
+	entries.push_back(subfileType);
+	entries.push_back(width);
+	entries.push_back(height);
+	entries.push_back(bits);
+	entries.push_back(compression);
+	entries.push_back(photometric);
+	if (!description.empty())
+		entries.push_back(imageDescription);
+	entries.push_back(stripOffsets);
+	entries.push_back(samplesPerPixel);
+	entries.push_back(rowsPerStrip);
+	entries.push_back(stripByteCounts);
+	entries.push_back(planarConfig);
+	if (_compression == Lzw)
+		entries.push_back(predictor);
+
+	// IFD, no next page yet
+	std::vector<uint8_t> ifd(2 + entries.size() * 12 + 4, 0);
+	uint16_t entriesCount = static_cast<uint16_t>(entries.size());
+	memcpy(&ifd[0], &entriesCount, 2);
+	for (size_t i = 0; i < entries.size(); i++) {
+		memcpy(&ifd[2 + i * 12], &entries[i].tag, 2);
+		memcpy(&ifd[2 + i * 12 + 2], &entries[i].type, 2);
+		memcpy(&ifd[2 + i * 12 + 4], &entries[i].count, 4);
+		memcpy(&ifd[2 + i * 12 + 8], &entries[i].value, 4);
+	}
+	uint32_t ifdOffset = append(ifd.data(), ifd.size());
+
+	// link it from the previous one
+	fseek(_file, _nextIfdPos, SEEK_SET);
+	fwrite(&ifdOffset, 4, 1, _file);
+	_nextIfdPos = ifdOffset + 2 + static_cast<uint32_t>(entries.size()) * 12;
+
+	return ferror(_file) == 0;
+}
@@ -0,0 +1,84 @@
+/*
+* BioLines (https://github.com/mmuszkow/BioLines)
+* Detection of filamentous structures in biological microscopic images
+* Copyright(C) 2017 Maciek Muszkowski
+*
+* This program is free software : you can redistribute it and / or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Writes multi-page baseline TIFF files, 8-bit grayscale or BGR pages, page by page,
+// independent from OpenCV codecs so the compression can be chosen per file,
+// strips of a page are compressed in parallel and written to the file in the order they are done
+class TiffWriter {
+public:
+	// values of the TIFF Compression tag
+	enum Compression {
+		NoCompression = 1,
+		Lzw = 5,
+		// fast run-length encoding, compresses the label maps well
+		PackBits = 32773
+	};
+
+	static const int ROWS_PER_STRIP = 64;
+
+private:
+	FILE* _file;
+	Compression _compression;
+	// threads compressing the strips, including the caller
+	int _threads;
+	// where the offset of the next page IFD has to be written
+	uint32_t _nextIfdPos;
+
+	struct Entry {
+		uint16_t tag, type;
+		uint32_t count, value;
+	};
+
+	// appends data at the end of the file, word aligned, returns its offset
+	uint32_t append(const void* data, size_t size);
+	// compressed strip, waiting to be written
+	struct EncodedStrip {
+		int index;
+		std::vector<uint8_t>* data;
+	};
+
+	// copies the strip in file order, applies the predictor and compresses it, thread-safe
+	std::vector<uint8_t> encodeStrip(const cv::Mat& img, int strip) const;
+	// compresses single strip, rows are contiguous
+	std::vector<uint8_t> compress(const uint8_t* strip, int rows, int rowBytes) const;
+
+public:
+	TiffWriter(const std::string& fn, Compression compression, int threads = 1);
+	~TiffWriter();
+
+	inline bool isOpen() const {
+		return _file != NULL;
+	}
+
+	// appends a page, CV_8UC1 or CV_8UC3 image, the description is stored in the ImageDescription tag
+	bool addPage(const cv::Mat& img, const std::string& description = "");
+
+	// run-length encodes single row
+	static void packBits(const uint8_t* row, int len, std::vector<uint8_t>& out);
+	// replaces the samples with differences to the previous pixel in the row, makes gradients compress better with lzw
+	static void horizontalPredictor(uint8_t* row, int len, int channels);
+};
@@ -0,0 +1,225 @@
+/*
+* BioLines (https://github.com/mmuszkow/BioLines)
+* Detection of filamentous structures in biological microscopic images
+* Copyright(C) 2017 Maciek Muszkowski
+*
+* This program is free software : you can redistribute it and / or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "stdafx.h"
+#include "workerpool.h"
+#include <algorithm>
+#include <bitset>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <string>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <dirent.h>
+#include <cstdio>
+#endif
+
+WorkerPool::WorkerPool(int threads, bool pin, bool lowPriority) : _active(0), _quit(false), _cores(availableCores()),
+	_requestedThreads(threads), _requestedPin(pin), _lowPriority(lowPriority), _pinned(false) {
+	if (threads <= 0)
+		threads = std::max(1, _cores - 1);
+
+	// workers spread evenly over the nodes, there's nothing to gain on a single node
+	std::vector<int> ids;
+	if (pin)
+		ids = nodes();
+	_pinned = ids.size() > 1;
+
+	for (int i = 0; i < threads; i++)
+		_threads.push_back(std::thread(&WorkerPool::work, this, _pinned ? ids[i % ids.size()] : -1));
+}
+
+WorkerPool::~WorkerPool() {
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_quit = true;
+	}
+	_queued.notify_all();
+	for (std::vector<std::thread>::iterator it = _threads.begin(); it != _threads.end(); ++it)
+		it->join();
+}
+
+void WorkerPool::start(QRunnable* runnable) {
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_queue.push_back(runnable);
+	}
+	_queued.notify_one();
+}
+
+int WorkerPool::helperThreads() {
+	if (_requestedPin || _lowPriority) return 1;
+	std::lock_guard<std::mutex> lock(_mutex);
+	int runnables = _active + static_cast<int>(_queue.size());
+	return std::max(1, _cores / std::max(1, runnables));
+}
+
+bool WorkerPool::waitForDone(int msecs) {
+	std::unique_lock<std::mutex> lock(_mutex);
+	return _idle.wait_for(lock, std::chrono::milliseconds(msecs), [this]() { return _queue.empty() && _active == 0; });
+}
+
+void WorkerPool::work(int node) {
+	// set once, the thread lives as long as the pool
+	if (node >= 0)
+		pinCurrentThread(node);
+	if (_lowPriority)
+		lowerCurrentThreadPriority();
+
+	for (;;) {
+		QRunnable* runnable;
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_queued.wait(lock, [this]() { return _quit || !_queue.empty(); });
+			// queue is drained before quitting
+			if (_queue.empty()) return;
+			runnable = _queue.front();
+			_queue.pop_front();
+			_active++;
+		}
+
+		bool autoDelete = runnable->autoDelete();
+		runnable->run();
+		if (autoDelete)
+			delete runnable;
+
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_active--;
+			if (_active == 0 && _queue.empty())
+				_idle.notify_all();
+		}
+	}
+}
+
+#ifndef _WIN32
+// CPU quota of the cgroup in cores, rounded up, 0 if there's none
+static int cgroupCores() {
+	// cgroup v2, "max 100000" or "<quota> <period>"
+	std::ifstream v2("/sys/fs/cgroup/cpu.max");
+	std::string quota;
+	long long period;
+	if (v2 >> quota >> period) {
+		if (quota == "max" || period <= 0) return 0;
+		return static_cast<int>(std::ceil(std::stoll(quota) / static_cast<double>(period)));
+	}
+	// cgroup v1, quota -1 if there's none
+	std::ifstream v1Quota("/sys/fs/cgroup/cpu/cpu.cfs_quota_us"), v1Period("/sys/fs/cgroup/cpu/cpu.cfs_period_us");
+	long long quotaUs, periodUs;
+	if (v1Quota >> quotaUs && v1Period >> periodUs && quotaUs > 0 && periodUs > 0)
+		return static_cast<int>(std::ceil(quotaUs / static_cast<double>(periodUs)));
+	return 0;
+}
+#endif
+
+int WorkerPool::availableCores() {
+	int cores = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+	int available = cores;
+#ifdef _WIN32
+	DWORD_PTR processMask, systemMask;
+	if (GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask) && processMask != 0)
+		available = std::min(available, static_cast<int>(std::bitset<64>(processMask).count()));
+
+	// hard cap of the job object, in 1/100 of % of all the processors
+	JOBOBJECT_CPU_RATE_CONTROL_INFORMATION rate = {};
+	if (QueryInformationJobObject(NULL, JobObjectCpuRateControlInformation, &rate, sizeof(rate), NULL) &&
+		(rate.ControlFlags & JOB_OBJECT_CPU_RATE_CONTROL_ENABLE) &&
+		(rate.ControlFlags & JOB_OBJECT_CPU_RATE_CONTROL_HARD_CAP) &&
+		!(rate.ControlFlags & JOB_OBJECT_CPU_RATE_CONTROL_WEIGHT_BASED))
+		available = std::min(available, static_cast<int>(std::ceil(rate.CpuRate / 10000.0 * cores)));
+#else
+	cpu_set_t set;
+	if (sched_getaffinity(0, sizeof(set), &set) == 0)
+		available = std::min(available, CPU_COUNT(&set));
+	int quota = cgroupCores();
+	if (quota > 0)
+		available = std::min(available, quota);
+#endif
+	return std::max(1, available);
+}
+
+std::vector<int> WorkerPool::nodes() {
+	std::vector<int> ids;
+#ifdef _WIN32
+	ULONG highest = 0;
+	if (GetNumaHighestNodeNumber(&highest))
+		for (ULONG node = 0; node <= highest; node++) {
+			GROUP_AFFINITY affinity = {};
+			if (GetNumaNodeProcessorMaskEx(static_cast<USHORT>(node), &affinity) && affinity.Mask != 0)
+				ids.push_back(static_cast<int>(node));
+		}
+#else
+	DIR* dir = opendir("/sys/devices/system/node");
+	if (!dir) return ids;
+	while (struct dirent* entry = readdir(dir)) {
+		int node;
+		char rest;
+		if (sscanf(entry->d_name, "node%d%c", &node, &rest) == 1)
+			ids.push_back(node);
+	}
+	closedir(dir);
+	std::sort(ids.begin(), ids.end());
+#endif
+	return ids;
+}
+
+bool WorkerPool::pinCurrentThread(int node) {
+#ifdef _WIN32
+	GROUP_AFFINITY affinity = {};
+	if (!GetNumaNodeProcessorMaskEx(static_cast<USHORT>(node), &affinity) || affinity.Mask == 0)
+		return false;
+	return SetThreadGroupAffinity(GetCurrentThread(), &affinity, NULL) != 0;
+#else
+	// "0-7,16-23"
+	std::ifstream list("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+	std::string ranges, range;
+	if (!std::getline(list, ranges)) return false;
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	std::stringstream stream(ranges);
+	while (std::getline(stream, range, ',')) {
+		if (range.empty()) continue;
+		size_t dash = range.find('-');
+		int first = std::stoi(range);
+		int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+		for (int cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++)
+			CPU_SET(cpu, &set);
+	}
+	return CPU_COUNT(&set) > 0 && pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#endif
+}
+
+void WorkerPool::lowerCurrentThreadPriority() {
+#ifdef _WIN32
+	// lowers the I/O and memory priority too
+	SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+#elif defined(SCHED_IDLE)
+	sched_param param = {};
+	pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+#endif
+}
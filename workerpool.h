@@ -0,0 +1,89 @@
+/*
+* BioLines (https://github.com/mmuszkow/BioLines)
+* Detection of filamentous structures in biological microscopic images
+* Copyright(C) 2017 Maciek Muszkowski
+*
+* This program is free software : you can redistribute it and / or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class QRunnable;
+
+// Fixed set of worker threads running QRunnables, started once and kept until destroyed, so they are warm between
+// the runs. Workers can be pinned to the NUMA nodes, spread evenly over them, each worker allocates and first
+// touches the buffers of its image itself, so with pinning they end up in the local memory of its node.
+// Workers can also run at background priority, for shared workstations.
+class WorkerPool {
+	std::vector<std::thread> _threads;
+	// queued runnables, guarded by the mutex
+	std::mutex _mutex;
+	std::condition_variable _queued, _idle;
+	std::deque<QRunnable*> _queue;
+	// runnables being run
+	int _active;
+	bool _quit;
+	// cores available when the pool was created
+	int _cores;
+	// settings as requested, and if the workers are really pinned
+	int _requestedThreads;
+	bool _requestedPin, _lowPriority, _pinned;
+
+	// worker thread main loop, node -1 - not pinned
+	void work(int node);
+
+	// ids of the NUMA nodes with processors, empty if they can't be read
+	static std::vector<int> nodes();
+	// binds the calling thread to the processors of the node
+	static bool pinCurrentThread(int node);
+	// lowers the calling thread priority to background
+	static void lowerCurrentThreadPriority();
+
+public:
+	// threads 0 - all available cores but one
+	WorkerPool(int threads = 0, bool pin = false, bool lowPriority = false);
+	// runs what's queued and joins the threads
+	~WorkerPool();
+
+	// queues the runnable, it's deleted after running if it's auto-deleted
+	void start(QRunnable* runnable);
+	// true if all the runnables are done, false on timeout
+	bool waitForDone(int msecs);
+
+	// true if the pool was created with the same settings
+	inline bool created(int threads, bool pin, bool lowPriority) const {
+		return _requestedThreads == threads && _requestedPin == pin && _lowPriority == lowPriority;
+	}
+	inline int threadCount() const {
+		return static_cast<int>(_threads.size());
+	}
+	// pinning is skipped on single node machines
+	inline bool pinned() const {
+		return _pinned;
+	}
+
+	// threads a runnable may start for itself, the available cores shared by the runnables queued or being run,
+	// 1 when the workers are pinned or at background priority as its threads wouldn't be
+	int helperThreads();
+
+	// cores the process may use, limited by its affinity mask and by the CPU quota of its cgroup or job object
+	static int availableCores();
+};